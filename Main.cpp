@@ -14,10 +14,78 @@
  * Третий алгоритм вычисляет важность каждого часа, затраченного на
  * посещение, и учитывает этот фактор.
  * 
+ * Четвертый алгоритм находит точный оптимум по суммарной важности
+ * динамическим программированием по времени (задача о рюкзаке).
+ * Строки ДП могут обновляться параллельно на пуле потоков,
+ * замер масштабирования запускается с аргументом --bench-dp.
+ * 
+ * Пятый алгоритм находит тот же оптимум методом ветвей и границ по порядку
+ * важности в час, дерево поиска обходится пулом потоков с перехватом задач
+ * (--bench-bb).
+ * 
+ * Шестой алгоритм - локальный поиск, улучшающий ответ третьего.
+ * 
+ * У мест есть стоимость входа, VisitWithinBudget учитывает и время, и бюджет
+ * на билеты: точной ДП для небольших бюджетов и лагранжевой релаксацией
+ * для больших, VisitByEfficiency - жадный аналог третьего алгоритма.
+ * 
+ * Место можно осмотреть за разное время с разной важностью: строки каталога
+ * с одинаковым названием становятся вариантами одного места (GroupByName),
+ * SolveMultiChoiceDP выбирает не больше одного варианта на место точно,
+ * VisitMultiChoiceGreedy - быстро по выпуклым оболочкам вариантов.
+ * 
+ * Правила состава маршрута (PlaceRules): категории мест с квотами
+ * "не меньше / не больше" и группы взаимоисключающих мест. SolveWithRules
+ * находит оптимум с правилами методом ветвей и границ, VisitWithRules -
+ * быстрый жадный вариант.
+ * 
+ * Ограничения предшествования (Precedence): место посещается после другого
+ * и, если ограничение обязательное, только вместе с ним. SolveWithPrecedence
+ * решает лес зависимостей ДП по дереву, остальные - ветвями и границами,
+ * и упорядочивает маршрут.
+ * 
+ * Часы работы (Timetable): посещение должно начаться в одно из окон места
+ * и не попадать на сон. ScheduleVisits выбирает места и время начала
+ * ДП по меткам (время, посещенные места) с отсевом доминируемых меток.
+ * Если важность зависит от часа начала посещения (ValueProfile),
+ * PlanTimeDependent строит расписание ДП по часам поездки.
+ * 
+ * Длительность посещения на деле случайна: MonteCarloEvaluator оценивает
+ * вероятность не уложиться во время и среднюю важность любого маршрута
+ * на общих сценариях, PlanChanceConstrained выбирает самый важный маршрут
+ * с заданной допустимой вероятностью опоздания.
+ * 
+ * Все алгоритмы можно запустить одновременно (RunPortfolio): возвращается
+ * лучший маршрут, найденный к крайнему сроку или к завершению точного алгоритма.
+ * SolveAnytime последовательно улучшает ответ третьего алгоритма до крайнего
+ * срока или отмены и возвращает лучший маршрут с доказанным разрывом до оптимума.
+ * 
  * -------------
  * 
  * Алгоритмы возвращают объекты класса Route, в которых содержится
  * маршрут и перегрузка оператора << для простоты вывода.
+ * Каталог мест по умолчанию встроен в программу, но может быть загружен
+ * из файла CSV или TSV (название, время, важность[, стоимость]): --catalog <файл>.
+ * Для больших каталогов есть двоичный формат, который отображается в память
+ * и используется без разбора: --convert <csv> <файл>, --mapped <файл>,
+ * замер запуска: --bench-startup <csv> [<двоичный файл>].
+ * 
+ * С аргументом --json результаты всех алгоритмов выводятся массивом JSON.
+ * 
+ * Пакетный режим --batch [файл] читает запросы из файла или стандартного
+ * ввода, по одному в строке: "<время поездки> <время сна> <алгоритм>
+ * [<индекс места>=<время>:<важность> ...] [+<индекс> ...] [-<индекс> ...]",
+ * например "48 16 VisitOptimal" ("+индекс" - обязательное место, "-индекс" -
+ * исключенное; ограничения доступны всем алгоритмам через Plan с Constraints).
+ * Ответы выводятся в порядке запросов (--json - по строке JSON на ответ,
+ * --threads N - число потоков решения, --cache N - кэш на N результатов).
+ * 
+ * Режим сервера --serve <сокет> держит каталог и индексы в памяти и отвечает
+ * на те же запросы через локальный сокет, по строке JSON на запрос.
+ * 
+ * Первые три алгоритма также доступны как генераторы на сопрограммах
+ * (StreamMostPlaces, StreamByValue, StreamByHourValue), выдающие места
+ * по одному по мере выбора.
  * 
  * В коде используется функционал C++20, протестировано с компилятором
  * MSVC в Visual Studio 2022.
@@ -28,9 +96,29 @@
  * - Первый: 29 часов, 114 важность, 11 мест
  * - Второй: 25 часов, 90 важность, 5 мест
  * - Третий: 31.5 часов, 133 важность, 10 мест
+ * - Четвертый: 31.5 часов, 133 важность, 10 мест
+ * - Пятый: 31.5 часов, 133 важность, 10 мест
+ * - Шестой: 31.5 часов, 133 важность, 10 мест
+ * - RouteEncoder: маршрут четвертого алгоритма кодируется в 26 байт
+ * - WhatIfTable: с местом "Navestit druzej" 31.5 часов, 131 важность, 9 мест,
+ *   без него - 133 важность, как у четвертого
+ * - SolveMultiChoiceDP (с коротким осмотром долгих мест): 32 часа, 143 важность, 12 мест
+ * - VisitMultiChoiceGreedy: 30.5 часов, 141 важность, 12 мест
+ * - SolveWithRules (не больше 6 платных мест, одно из двух самых важных в час):
+ *   30.5 часов, 117 важность, 8 мест
+ * - VisitWithRules: 30.5 часов, 117 важность, 8 мест
+ * - SolveWithPrecedence (самое важное в час место - только после наименее
+ *   важного): 30.5 часов, 122 важность, 10 мест
+ * - ScheduleVisits (платные места открыты с 10:00 до 20:00): 23.5 часа,
+ *   114 важность, 9 мест
+ * - PlanTimeDependent (то же расписание, бесплатные места в полтора раза
+ *   важнее с 19:00 до 23:00): 27 часов, 124 важность, 8 мест
+ * - PlanChanceConstrained (опоздание не чаще 5%): 28 часов, 125 важность, 10 мест,
+ *   опоздание в 3.2% сценариев против 40.5% у маршрута четвертого алгоритма
  * 
  * Третий алгоритм получился наиболее эффективным как в использовании времени,
- * так и в суммарной важности посещенных мест.
+ * так и в суммарной важности посещенных мест. Точные алгоритмы подтверждают,
+ * что на этих данных его результат оптимален.
  */
 
 #include <map>
@@ -41,6 +129,55 @@
 #include <iostream>
 #include <numeric>
 #include <format>
+#include <iterator>
+#include <thread>
+#include <future>
+#include <functional>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <span>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <string_view>
+#include <bit>
+#include <optional>
+#include <stop_token>
+#include <limits>
+#include <coroutine>
+#include <exception>
+#include <fstream>
+#include <charconv>
+#include <stdexcept>
+#include <cstring>
+#include <unordered_map>
+#include <set>
+#include <queue>
+#include <array>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cerrno>
+#endif
+#include <csignal>
 
 namespace test
 {
@@ -49,35 +186,342 @@ namespace test
 	constexpr float VISIT_TIME = 48.0f;
 	constexpr float SLEEP_TIME = 16.0f;
 
+	// шаг дискретизации времени для точных алгоритмов.
+	// все времена в тз кратны получасу
+	constexpr float TIME_STEP = 0.5f;
+
+	// бюджет на входные билеты, руб.
+	constexpr int MONEY_BUDGET = 3000;
+
 	struct Place
 	{
 		std::string	name;
 		float		time;
 		int			value;
+		// стоимость входа, руб.
+		int			cost = 0;
 	};
 
 	const std::vector<Place> places =
 	{
-		{	"Isaakievskij sobor",								5.0f,	10	},
-		{	"Ermitazh",											8.0f,	11	},
-		{	"Kunstkamera",										3.5f,	4	},
-		{	"Petropavlovskaya krepost",							10.0f,	7	},
-		{	"Leningradskij zoopark",							9.0f,	15	},
-		{	"Mednyj vsadnik",									1.0f,	17	},
-		{	"Kazanskij sobor",									4.0f,	3	},
-		{	"Spas na Krovi",									2.0f,	9	},
-		{	"Zimnij dvorec Petra I",							7.0f,	12	},
-		{	"Zoologicheskij muzej",								5.5f,	6	},
-		{	"Muzej oborony i blokady Leningrada",				2.0f,	19	},
-		{	"Russkij muzej",									5.0f,	8	},
-		{	"Navestit druzej",									12.0f,	20	},
-		{	"Muzej voskovyh figur",								2.0f,	13	},
-		{	"Literaturno-memorialnyj muzej F.M. Dostoevskogo",	4.0f,	2	},
-		{	"Ekaterininskij dvorec",							1.5f,	5	},
-		{	"Peterburgskij muzej kukol",						1.0f,	14	},
-		{	"Muzej mikrominiatyury \"Russkij Levsha\"",			3.0f,	18	},
-		{	"Vserossijskij muzej A.S.Pushkina i filialy",		6.0f,	1	},
-		{	"Muzej sovremennogo iskusstva Erarta",				7.0f,	16	}
+		{	"Isaakievskij sobor",								5.0f,	10,	400	},
+		{	"Ermitazh",											8.0f,	11,	500	},
+		{	"Kunstkamera",										3.5f,	4,	300	},
+		{	"Petropavlovskaya krepost",							10.0f,	7,	700	},
+		{	"Leningradskij zoopark",							9.0f,	15,	1000	},
+		{	"Mednyj vsadnik",									1.0f,	17,	0	},
+		{	"Kazanskij sobor",									4.0f,	3,	0	},
+		{	"Spas na Krovi",									2.0f,	9,	400	},
+		{	"Zimnij dvorec Petra I",							7.0f,	12,	500	},
+		{	"Zoologicheskij muzej",								5.5f,	6,	400	},
+		{	"Muzej oborony i blokady Leningrada",				2.0f,	19,	350	},
+		{	"Russkij muzej",									5.0f,	8,	500	},
+		{	"Navestit druzej",									12.0f,	20,	0	},
+		{	"Muzej voskovyh figur",								2.0f,	13,	600	},
+		{	"Literaturno-memorialnyj muzej F.M. Dostoevskogo",	4.0f,	2,	300	},
+		{	"Ekaterininskij dvorec",							1.5f,	5,	1000	},
+		{	"Peterburgskij muzej kukol",						1.0f,	14,	400	},
+		{	"Muzej mikrominiatyury \"Russkij Levsha\"",			3.0f,	18,	500	},
+		{	"Vserossijskij muzej A.S.Pushkina i filialy",		6.0f,	1,	400	},
+		{	"Muzej sovremennogo iskusstva Erarta",				7.0f,	16,	700	}
+	};
+
+	// -------------
+	// загрузка каталога из файла
+	// -------------
+
+	// чтение файла целиком в один буфер
+	std::string ReadFile(const std::string& path)
+	{
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in) throw std::runtime_error(std::format("cannot open '{}'", path));
+		std::string buf(static_cast<size_t>(in.tellg()), '\0');
+		in.seekg(0);
+		in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+		return buf;
+	}
+
+	// разбор каталога в формате CSV или TSV: название, время, важность
+	// и необязательная стоимость входа.
+	// разделитель определяется по первой строке, строка заголовка
+	// (с нечисловым временем) пропускается. Названия в CSV могут быть
+	// в кавычках, кавычка внутри названия записывается как "".
+	// числа разбираются std::from_chars прямо из буфера
+	std::vector<Place> ParseCatalog(std::string_view text)
+	{
+		std::vector<Place> res;
+		res.reserve(static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) + 1);
+
+		const char* pos = text.data();
+		const char* const end = pos + text.size();
+		if (text.starts_with("\xEF\xBB\xBF")) pos += 3;
+
+		const char* firstEol = std::find(pos, end, '\n');
+		const char delim = std::find(pos, firstEol, '\t') != firstEol ? '\t' : ',';
+
+		auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+		auto fail = [](size_t line, std::string_view what) -> std::runtime_error
+		{
+			return std::runtime_error(std::format("catalog line {}: {}", line, what));
+		};
+
+		for (size_t line = 1; pos < end; ++line)
+		{
+			const char* eol = std::find(pos, end, '\n');
+			const char* rowEnd = eol;
+			while (rowEnd > pos && rowEnd[-1] == '\r') --rowEnd;
+			if (rowEnd == pos)
+			{
+				pos = eol + (eol < end);
+				continue;
+			}
+
+			// название
+			Place place;
+			const char* cur = pos;
+			if (delim == ',' && *cur == '"')
+			{
+				for (++cur;; ++cur)
+				{
+					if (cur >= rowEnd) throw fail(line, "unterminated quoted name");
+					if (*cur != '"') { place.name.push_back(*cur); continue; }
+					if (cur + 1 < rowEnd && cur[1] == '"') { place.name.push_back('"'); ++cur; continue; }
+					++cur;
+					break;
+				}
+				if (cur < rowEnd && *cur != delim) throw fail(line, "text after quoted name");
+			}
+			else
+			{
+				const char* nameEnd = std::find(cur, rowEnd, delim);
+				place.name.assign(cur, nameEnd);
+				cur = nameEnd;
+			}
+			if (cur >= rowEnd) throw fail(line, "expected 3 fields");
+			++cur;
+
+			// время и важность
+			auto field = [&](auto& out) -> bool
+			{
+				while (cur < rowEnd && isSpace(*cur) && *cur != delim) ++cur;
+				const auto [ptr, ec] = std::from_chars(cur, rowEnd, out);
+				if (ec != std::errc()) return false;
+				cur = ptr;
+				while (cur < rowEnd && isSpace(*cur) && *cur != delim) ++cur;
+				return true;
+			};
+
+			const bool timeOk = field(place.time);
+			if (!timeOk && res.empty() && line == 1)
+			{
+				pos = eol + (eol < end);
+				continue;
+			}
+			if (!timeOk) throw fail(line, "invalid time");
+			if (cur >= rowEnd || *cur != delim) throw fail(line, "expected 3 fields");
+			++cur;
+			if (!field(place.value)) throw fail(line, "invalid value");
+			if (cur < rowEnd && *cur == delim)
+			{
+				++cur;
+				if (!field(place.cost)) throw fail(line, "invalid cost");
+			}
+			if (cur != rowEnd) throw fail(line, "unexpected trailing data");
+			if (!std::isfinite(place.time) || !(place.time > 0)) throw fail(line, "time must be positive and finite");
+			if (place.cost < 0) throw fail(line, "cost must not be negative");
+
+			res.push_back(std::move(place));
+			pos = eol + (eol < end);
+		}
+		return res;
+	}
+
+	std::vector<Place> LoadCatalog(const std::string& path)
+	{
+		return ParseCatalog(ReadFile(path));
+	}
+
+	// -------------
+	// двоичный формат каталога для отображения в память
+	// -------------
+
+	// файл состоит из заголовка и столбцов, выровненных по 64 байтам:
+	// время (float), важность (int32), смещения названий (uint64, count + 1),
+	// таблица строк с названиями подряд и стоимость (int32). Числа хранятся
+	// в порядке байтов little-endian, столбцы используются напрямую без
+	// разбора и копирования. В файлах версии 1 столбца стоимости нет
+	constexpr char BINARY_CATALOG_MAGIC[4] = { 'T', 'C', 'A', 'T' };
+	constexpr uint32_t BINARY_CATALOG_VERSION = 2;
+	constexpr uint64_t BINARY_CATALOG_ALIGN = 64;
+
+	struct BinaryCatalogHeader
+	{
+		char		magic[4];
+		uint32_t	version;
+		uint64_t	count;
+		uint64_t	timesOffset;
+		uint64_t	valuesOffset;
+		uint64_t	nameIndexOffset;
+		uint64_t	namesOffset;
+		uint64_t	namesSize;
+		uint64_t	costsOffset;
+	};
+	static_assert(sizeof(BinaryCatalogHeader) == BINARY_CATALOG_ALIGN);
+
+	// запись каталога в двоичном формате
+	void WriteBinaryCatalog(const std::vector<Place>& catalog, const std::string& path)
+	{
+		auto align = [](uint64_t off) { return (off + BINARY_CATALOG_ALIGN - 1) / BINARY_CATALOG_ALIGN * BINARY_CATALOG_ALIGN; };
+
+		BinaryCatalogHeader h{};
+		std::copy(std::begin(BINARY_CATALOG_MAGIC), std::end(BINARY_CATALOG_MAGIC), h.magic);
+		h.version = BINARY_CATALOG_VERSION;
+		h.count = catalog.size();
+		h.timesOffset = sizeof(h);
+		h.valuesOffset = align(h.timesOffset + h.count * sizeof(float));
+		h.nameIndexOffset = align(h.valuesOffset + h.count * sizeof(int32_t));
+		h.namesOffset = align(h.nameIndexOffset + (h.count + 1) * sizeof(uint64_t));
+		for (const auto& p : catalog) h.namesSize += p.name.size();
+		h.costsOffset = align(h.namesOffset + h.namesSize);
+
+		std::string buf(static_cast<size_t>(h.costsOffset + h.count * sizeof(int32_t)), '\0');
+		std::memcpy(buf.data(), &h, sizeof(h));
+		uint64_t nameOff = 0;
+		for (size_t i = 0; i < catalog.size(); ++i)
+		{
+			const int32_t value = catalog[i].value;
+			std::memcpy(buf.data() + h.timesOffset + i * sizeof(float), &catalog[i].time, sizeof(float));
+			const int32_t cost = catalog[i].cost;
+			std::memcpy(buf.data() + h.valuesOffset + i * sizeof(int32_t), &value, sizeof(int32_t));
+			std::memcpy(buf.data() + h.costsOffset + i * sizeof(int32_t), &cost, sizeof(int32_t));
+			std::memcpy(buf.data() + h.nameIndexOffset + i * sizeof(uint64_t), &nameOff, sizeof(uint64_t));
+			std::memcpy(buf.data() + h.namesOffset + nameOff, catalog[i].name.data(), catalog[i].name.size());
+			nameOff += catalog[i].name.size();
+		}
+		std::memcpy(buf.data() + h.nameIndexOffset + h.count * sizeof(uint64_t), &nameOff, sizeof(uint64_t));
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out.write(buf.data(), static_cast<std::streamsize>(buf.size())))
+			throw std::runtime_error(std::format("cannot write '{}'", path));
+	}
+
+	// каталог в двоичном формате, отображенный в память только для чтения
+	class MappedCatalog
+	{
+	public:
+		explicit MappedCatalog(const std::string& path)
+		{
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			LARGE_INTEGER fileSize{};
+			if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+			{
+				Close();
+				throw std::runtime_error(std::format("cannot open '{}'", path));
+			}
+			size = static_cast<size_t>(fileSize.QuadPart);
+			mapping = size ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+			data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+			const int fd = open(path.c_str(), O_RDONLY);
+			struct stat st{};
+			if (fd < 0 || fstat(fd, &st) != 0)
+			{
+				if (fd >= 0) close(fd);
+				throw std::runtime_error(std::format("cannot open '{}'", path));
+			}
+			size = static_cast<size_t>(st.st_size);
+			void* p = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+			close(fd);
+			data = p == MAP_FAILED ? nullptr : static_cast<const char*>(p);
+#endif
+			try
+			{
+				Validate(path);
+			}
+			catch (...)
+			{
+				Close();
+				throw;
+			}
+		}
+
+		MappedCatalog(const MappedCatalog&) = delete;
+		MappedCatalog& operator=(const MappedCatalog&) = delete;
+		~MappedCatalog() { Close(); }
+
+		size_t Size() const { return static_cast<size_t>(header->count); }
+		std::span<const float> Times() const { return { reinterpret_cast<const float*>(data + header->timesOffset), Size() }; }
+		std::span<const int32_t> Values() const { return { reinterpret_cast<const int32_t*>(data + header->valuesOffset), Size() }; }
+
+		// пусто для файлов версии 1
+		std::span<const int32_t> Costs() const
+		{
+			if (header->version < 2) return {};
+			return { reinterpret_cast<const int32_t*>(data + header->costsOffset), Size() };
+		}
+
+		std::string_view Name(size_t i) const
+		{
+			const uint64_t* index = reinterpret_cast<const uint64_t*>(data + header->nameIndexOffset);
+			const uint64_t end = std::min(index[i + 1], header->namesSize);
+			const uint64_t begin = std::min(index[i], end);
+			return { data + header->namesOffset + begin, static_cast<size_t>(end - begin) };
+		}
+
+		Place At(size_t i) const
+		{
+			const auto costs = Costs();
+			return { std::string(Name(i)), Times()[i], Values()[i], costs.empty() ? 0 : costs[i] };
+		}
+
+	private:
+		void Validate(const std::string& path)
+		{
+			auto fail = [&](std::string_view what) { return std::runtime_error(std::format("'{}': {}", path, what)); };
+			if (!data || size < sizeof(BinaryCatalogHeader)) throw fail("not a binary catalog");
+			header = reinterpret_cast<const BinaryCatalogHeader*>(data);
+			if (!std::equal(std::begin(BINARY_CATALOG_MAGIC), std::end(BINARY_CATALOG_MAGIC), header->magic)) throw fail("not a binary catalog");
+			if (header->version == 0 || header->version > BINARY_CATALOG_VERSION) throw fail(std::format("unsupported version {}", header->version));
+
+			const uint64_t n = header->count;
+			auto fits = [&](uint64_t off, uint64_t bytes) { return off % BINARY_CATALOG_ALIGN == 0 && off <= size && bytes <= size - off; };
+			if (n > size || !fits(header->timesOffset, n * sizeof(float)) || !fits(header->valuesOffset, n * sizeof(int32_t))
+				|| !fits(header->nameIndexOffset, (n + 1) * sizeof(uint64_t)) || !fits(header->namesOffset, header->namesSize)
+				|| (header->version >= 2 && !fits(header->costsOffset, n * sizeof(int32_t))))
+				throw fail("corrupted layout");
+
+			// те же проверки, что и при разборе текста: алгоритмы делят
+			// на время и не должны получать nan, inf или непозитивное время
+			const auto times = Times();
+			if (!std::all_of(times.begin(), times.end(), [](float t) { return std::isfinite(t) && t > 0; }))
+				throw fail("time must be positive and finite");
+			const auto costs = Costs();
+			if (!std::all_of(costs.begin(), costs.end(), [](int32_t c) { return c >= 0; }))
+				throw fail("cost must not be negative");
+		}
+
+		void Close()
+		{
+#ifdef _WIN32
+			if (data) UnmapViewOfFile(data);
+			if (mapping) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			mapping = nullptr;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (data) munmap(const_cast<char*>(data), size);
+#endif
+			data = nullptr;
+		}
+
+#ifdef _WIN32
+		HANDLE						file = INVALID_HANDLE_VALUE;
+		HANDLE						mapping = nullptr;
+#endif
+		const char*					data = nullptr;
+		size_t						size = 0;
+		const BinaryCatalogHeader*	header = nullptr;
 	};
 
 	struct Route
@@ -85,16 +529,393 @@ namespace test
 		std::vector<Place>	places;
 
 	public:
+		float TotalTime() const { return std::accumulate(places.begin(), places.end(), 0.0f, [](float t, const Place& p) { return t + p.time; }); }
+		int TotalValue() const { return std::accumulate(places.begin(), places.end(), 0, [](int v, const Place& p) { return v + p.value; }); }
+		int TotalCost() const { return std::accumulate(places.begin(), places.end(), 0, [](int c, const Place& p) { return c + p.cost; }); }
+
+		// запись текста маршрута в конец буфера без промежуточных строк,
+		// суммы считаются за один проход
+		void AppendTo(std::string& out) const
+		{
+			float time = 0;
+			int value = 0;
+			for (const auto& p : places)
+			{
+				time += p.time;
+				value += p.value;
+			}
+
+			auto it = std::back_inserter(out);
+			it = std::format_to(it, "Total time: {}; Total value: {}; Places visited: {}\n", time, value, places.size());
+			for (size_t i = 0; i < places.size(); ++i)
+				it = std::format_to(it, " - {} ({}h, {}){}", places[i].name, places[i].time, places[i].value,
+					(i == (places.size() - 1)) ? "" : ", \n");
+		}
+
 		friend std::ostream& operator<<(std::ostream& os, const Route& r)
 		{
-			os << std::format("Total time: {}; Total value: {}; Places visited: {}\n",
-				std::accumulate(r.places.begin(), r.places.end(), 0.0f, [](float t, const Place& p) { return t + p.time; }),
-				std::accumulate(r.places.begin(), r.places.end(), 0, [](int v, const Place& p) { return v + p.value; }),
-				r.places.size());
-			for (size_t i = 0; i < r.places.size(); ++i) os << std::format(" - {} ({}h, {})", r.places[i].name, r.places[i].time, r.places[i].value)
-				<< ((i == (r.places.size() - 1)) ? "" : ", \n");
-			return os;
+			// буфер переиспользуется между вызовами, поэтому после
+			// прогрева вывод не выделяет память
+			thread_local std::string buf;
+			buf.clear();
+			r.AppendTo(buf);
+			return os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+		}
+	};
+
+	// вывод большого числа маршрутов: текст накапливается в одном буфере
+	// и сбрасывается в поток кусками не меньше flushSize
+	class RouteWriter
+	{
+	public:
+		explicit RouteWriter(std::ostream& os, size_t flushSize = size_t(1) << 16) : os(os), flushSize(flushSize)
+		{
+			buf.reserve(flushSize * 2);
+		}
+		RouteWriter(const RouteWriter&) = delete;
+		RouteWriter& operator=(const RouteWriter&) = delete;
+		~RouteWriter() { Flush(); }
+
+		RouteWriter& operator<<(const Route& r)
+		{
+			r.AppendTo(buf);
+			return MaybeFlush();
+		}
+
+		RouteWriter& operator<<(std::string_view text)
+		{
+			buf.append(text);
+			return MaybeFlush();
+		}
+
+		void Flush()
+		{
+			os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+			buf.clear();
+		}
+
+	private:
+		RouteWriter& MaybeFlush()
+		{
+			if (buf.size() >= flushSize) Flush();
+			return *this;
+		}
+
+		std::ostream&	os;
+		size_t			flushSize;
+		std::string		buf;
+	};
+
+	// -------------
+	// двоичная сериализация маршрутов
+	// -------------
+
+	// отпечаток содержимого каталога (FNV-1a по названиям, времени, важности
+	// и стоимости).
+	// маршруты хранят индексы мест, поэтому декодировать их можно
+	// только с тем же каталогом
+	uint64_t CatalogFingerprint(const std::vector<Place>& catalog)
+	{
+		uint64_t h = 14695981039346656037ull;
+		auto mix = [&h](const void* data, size_t size)
+		{
+			for (size_t i = 0; i < size; ++i)
+			{
+				h ^= static_cast<const unsigned char*>(data)[i];
+				h *= 1099511628211ull;
+			}
+		};
+		for (const auto& p : catalog)
+		{
+			const uint64_t nameSize = p.name.size();
+			const uint32_t time = std::bit_cast<uint32_t>(p.time);
+			const int32_t value = p.value;
+			const int32_t cost = p.cost;
+			mix(&nameSize, sizeof(nameSize));
+			mix(p.name.data(), p.name.size());
+			mix(&time, sizeof(time));
+			mix(&value, sizeof(value));
+			mix(&cost, sizeof(cost));
+		}
+		return h;
+	}
+
+	// формат: версия (1 байт), отпечаток каталога (8 байт LE), число мест,
+	// суммарная важность (zigzag), суммарное время (float, 4 байта LE),
+	// индексы мест в каталоге. Целые числа кодируются varint.
+	// версия 2: в отпечаток каталога входит стоимость мест
+	constexpr uint8_t ROUTE_FORMAT_VERSION = 2;
+
+	// кодирование маршрутов для одного каталога. Места сопоставляются
+	// с индексами каталога через хеш-таблицу, построенную один раз
+	class RouteEncoder
+	{
+	public:
+		explicit RouteEncoder(const std::vector<Place>& catalog) : catalog(catalog), fingerprint(CatalogFingerprint(catalog))
+		{
+			index.reserve(catalog.size());
+			for (size_t i = 0; i < catalog.size(); ++i) index.emplace(catalog[i].name, i);
+		}
+
+		// дописывает маршрут в конец буфера
+		void Encode(const Route& r, std::vector<uint8_t>& out) const
+		{
+			out.push_back(ROUTE_FORMAT_VERSION);
+			PutFixed(out, fingerprint, 8);
+			PutVarint(out, r.places.size());
+
+			float time = 0;
+			int value = 0;
+			for (const auto& p : r.places)
+			{
+				time += p.time;
+				value += p.value;
+			}
+			PutVarint(out, (uint64_t(int64_t(value)) << 1) ^ uint64_t(int64_t(value) >> 63));
+			PutFixed(out, std::bit_cast<uint32_t>(time), 4);
+
+			for (const auto& p : r.places) PutVarint(out, IndexOf(p));
+		}
+
+	private:
+		size_t IndexOf(const Place& p) const
+		{
+			const auto [first, last] = index.equal_range(p.name);
+			for (auto it = first; it != last; ++it)
+			{
+				const Place& c = catalog[it->second];
+				if (c.time == p.time && c.value == p.value && c.cost == p.cost) return it->second;
+			}
+			throw std::invalid_argument(std::format("place '{}' is not in the catalog", p.name));
+		}
+
+		static void PutFixed(std::vector<uint8_t>& out, uint64_t v, int bytes)
+		{
+			for (int i = 0; i < bytes; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+		}
+
+		static void PutVarint(std::vector<uint8_t>& out, uint64_t v)
+		{
+			for (; v >= 0x80; v >>= 7) out.push_back(static_cast<uint8_t>(v | 0x80));
+			out.push_back(static_cast<uint8_t>(v));
+		}
+
+		const std::vector<Place>&							catalog;
+		uint64_t											fingerprint;
+		std::unordered_multimap<std::string_view, size_t>	index;
+	};
+
+	// просмотр закодированного маршрута без копирования: индексы
+	// декодируются по мере обхода. Конструктор проверяет данные целиком,
+	// буфер должен существовать, пока используется просмотр
+	class RouteView
+	{
+	public:
+		explicit RouteView(std::span<const uint8_t> data) : data(data)
+		{
+			size_t pos = 0;
+			if (data.empty() || data[0] != ROUTE_FORMAT_VERSION) throw std::runtime_error("unsupported route encoding");
+			pos = 1;
+			if (data.size() < pos + 8) throw std::runtime_error("truncated route");
+			for (int i = 0; i < 8; ++i) fingerprint |= uint64_t(data[pos + i]) << (8 * i);
+			pos += 8;
+
+			count = static_cast<size_t>(GetVarint(data, pos));
+			const uint64_t zz = GetVarint(data, pos);
+			value = static_cast<int>(static_cast<int64_t>(zz >> 1) ^ -static_cast<int64_t>(zz & 1));
+			if (data.size() < pos + 4) throw std::runtime_error("truncated route");
+			uint32_t timeBits = 0;
+			for (int i = 0; i < 4; ++i) timeBits |= uint32_t(data[pos + i]) << (8 * i);
+			time = std::bit_cast<float>(timeBits);
+			pos += 4;
+
+			indicesBegin = pos;
+			for (size_t i = 0; i < count; ++i) GetVarint(data, pos);
+			indicesEnd = pos;
+		}
+
+		class Iterator
+		{
+		public:
+			using value_type = size_t;
+			using difference_type = std::ptrdiff_t;
+
+			Iterator(std::span<const uint8_t> data, size_t pos) : data(data), pos(pos) {}
+			size_t operator*() const { size_t p = pos; return static_cast<size_t>(GetVarint(data, p)); }
+			Iterator& operator++() { GetVarint(data, pos); return *this; }
+			void operator++(int) { ++*this; }
+			bool operator==(const Iterator& other) const { return pos == other.pos; }
+
+		private:
+			std::span<const uint8_t>	data;
+			size_t						pos;
+		};
+
+		Iterator begin() const { return { data, indicesBegin }; }
+		Iterator end() const { return { data, indicesEnd }; }
+
+		uint64_t Fingerprint() const { return fingerprint; }
+		size_t Size() const { return count; }
+		int TotalValue() const { return value; }
+		float TotalTime() const { return time; }
+		// размер закодированного маршрута, следующий маршрут в потоке начинается сразу за ним
+		size_t EncodedSize() const { return indicesEnd; }
+
+		Route ToRoute(const std::vector<Place>& catalog) const { return ToRoute(catalog, CatalogFingerprint(catalog)); }
+
+		// вариант с заранее посчитанным отпечатком для декодирования потока маршрутов
+		Route ToRoute(const std::vector<Place>& catalog, uint64_t catalogFingerprint) const
+		{
+			if (catalogFingerprint != fingerprint) throw std::runtime_error("route was encoded for a different catalog");
+			Route r;
+			r.places.reserve(count);
+			for (size_t i : *this)
+			{
+				if (i >= catalog.size()) throw std::runtime_error("place index out of range");
+				r.places.push_back(catalog[i]);
+			}
+			return r;
+		}
+
+	private:
+		static uint64_t GetVarint(std::span<const uint8_t> data, size_t& pos)
+		{
+			uint64_t v = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				if (pos >= data.size()) throw std::runtime_error("truncated route");
+				const uint8_t b = data[pos++];
+				v |= uint64_t(b & 0x7F) << shift;
+				if (!(b & 0x80)) return v;
+			}
+			throw std::runtime_error("malformed varint");
+		}
+
+		std::span<const uint8_t>	data;
+		uint64_t					fingerprint = 0;
+		size_t						count = 0;
+		int							value = 0;
+		float						time = 0;
+		size_t						indicesBegin = 0;
+		size_t						indicesEnd = 0;
+	};
+
+	// -------------
+	// вывод маршрутов в JSON
+	// -------------
+
+	// строка JSON с экранированием кавычек, обратной косой черты
+	// и управляющих символов. Остальные байты UTF-8 копируются как есть
+	void AppendJsonString(std::string& out, std::string_view s)
+	{
+		out.push_back('"');
+		size_t run = 0;
+		for (size_t i = 0; i < s.size(); ++i)
+		{
+			const unsigned char c = static_cast<unsigned char>(s[i]);
+			if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+			out.append(s.data() + run, i - run);
+			run = i + 1;
+			switch (c)
+			{
+			case '"':	out.append("\\\""); break;
+			case '\\':	out.append("\\\\"); break;
+			case '\n':	out.append("\\n"); break;
+			case '\r':	out.append("\\r"); break;
+			case '\t':	out.append("\\t"); break;
+			default:	std::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(c)); break;
+			}
+		}
+		out.append(s.data() + run, s.size() - run);
+		out.push_back('"');
+	}
+
+	// число JSON: NaN и бесконечность в JSON не представимы
+	void AppendJsonNumber(std::string& out, float v)
+	{
+		if (std::isfinite(v)) std::format_to(std::back_inserter(out), "{}", v);
+		else out.append("null");
+	}
+
+	// запись маршрута объектом JSON в конец буфера.
+	// strategy, если задана, добавляется полем "strategy"
+	void AppendJson(std::string& out, const Route& r, std::string_view strategy = {})
+	{
+		float time = 0;
+		int value = 0, cost = 0;
+		for (const auto& p : r.places)
+		{
+			time += p.time;
+			value += p.value;
+			cost += p.cost;
+		}
+
+		out.push_back('{');
+		if (!strategy.empty())
+		{
+			out.append("\"strategy\":");
+			AppendJsonString(out, strategy);
+			out.push_back(',');
+		}
+		out.append("\"totalTime\":");
+		AppendJsonNumber(out, time);
+		std::format_to(std::back_inserter(out), ",\"totalValue\":{},\"totalCost\":{},\"places\":[", value, cost);
+		for (size_t i = 0; i < r.places.size(); ++i)
+		{
+			if (i) out.push_back(',');
+			out.append("{\"name\":");
+			AppendJsonString(out, r.places[i].name);
+			out.append(",\"time\":");
+			AppendJsonNumber(out, r.places[i].time);
+			std::format_to(std::back_inserter(out), ",\"value\":{},\"cost\":{}}}", r.places[i].value, r.places[i].cost);
+		}
+		out.append("]}");
+	}
+
+	// потоковая запись массива маршрутов в JSON без построения дерева:
+	// текст накапливается в буфере и сбрасывается кусками не меньше flushSize.
+	// массив закрывается в Finish или в деструкторе
+	class JsonRouteWriter
+	{
+	public:
+		explicit JsonRouteWriter(std::ostream& os, size_t flushSize = size_t(1) << 16) : os(os), flushSize(flushSize)
+		{
+			buf.reserve(flushSize * 2);
+			buf.push_back('[');
+		}
+		JsonRouteWriter(const JsonRouteWriter&) = delete;
+		JsonRouteWriter& operator=(const JsonRouteWriter&) = delete;
+		~JsonRouteWriter() { Finish(); }
+
+		void Write(const Route& r, std::string_view strategy = {})
+		{
+			if (written++) buf.push_back(',');
+			buf.push_back('\n');
+			AppendJson(buf, r, strategy);
+			if (buf.size() >= flushSize) Flush();
+		}
+
+		void Finish()
+		{
+			if (finished) return;
+			finished = true;
+			buf.append("\n]\n");
+			Flush();
+		}
+
+	private:
+		void Flush()
+		{
+			os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+			buf.clear();
 		}
+
+		std::ostream&	os;
+		size_t			flushSize;
+		std::string		buf;
+		size_t			written = 0;
+		bool			finished = false;
 	};
 
 	// кастомные компараторы для сортировки
@@ -114,108 +935,4428 @@ namespace test
 	{
 		bool operator()(const Place& p1, const Place& p2) const { return p1.value > p2.value; }
 	} CVG;
+	struct CompHourValueGreater
+	{
+		bool operator()(const Place& p1, const Place& p2) const { return p1.value / p1.time > p2.value / p2.time; }
+	} CHVG;
 
-	// первый алгоритм
-	Route VisitMostPlaces()
+	// генератор на сопрограммах C++20: значения передаются вызывающему
+	// по одному, по мере их вычисления. Выданная ссылка действительна
+	// до следующего шага генератора
+	template<class T>
+	class Generator
 	{
-		Route res;
-		float time = VISIT_TIME - SLEEP_TIME;
-		std::vector<Place> temp = places;
+	public:
+		struct promise_type
+		{
+			const T*			current = nullptr;
+			std::exception_ptr	error;
+
+			Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_always final_suspend() noexcept { return {}; }
+			std::suspend_always yield_value(const T& value) noexcept { current = std::addressof(value); return {}; }
+			void return_void() {}
+			void unhandled_exception() { error = std::current_exception(); }
+		};
 
-		// первая сортировка не влияет на результат в данном
-		// случае, однако в случае с более крупным набором
-		// данных, позволила бы увеличить совокупную важность.
-		// в случае использования двойной сортировки, вторая 
-		// сортировка должна использовать stable_sort
-		//std::sort(temp.begin(), temp.end(), CVG);
-		std::sort(temp.begin(), temp.end(), CTL);
+		struct Sentinel {};
 
-		// добавление мест в маршрут в пределах доступного времени
-		float accTime = 0;
-		for (const auto& p : temp)
+		class Iterator
 		{
-			accTime += p.time;
-			if (accTime <= time) res.places.push_back(p);
-			else break;
+		public:
+			using value_type = T;
+			using difference_type = std::ptrdiff_t;
+
+			explicit Iterator(std::coroutine_handle<promise_type> h) : handle(h) {}
+			const T& operator*() const { return *handle.promise().current; }
+			Iterator& operator++() { Advance(handle); return *this; }
+			void operator++(int) { ++*this; }
+			bool operator==(Sentinel) const { return handle.done(); }
+
+		private:
+			std::coroutine_handle<promise_type> handle;
+		};
+
+		Generator(Generator&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+		Generator& operator=(Generator&& other) noexcept
+		{
+			if (this != &other)
+			{
+				if (handle) handle.destroy();
+				handle = std::exchange(other.handle, nullptr);
+			}
+			return *this;
 		}
+		~Generator() { if (handle) handle.destroy(); }
 
-		return res;
+		Iterator begin() { Advance(handle); return Iterator(handle); }
+		Sentinel end() { return {}; }
+
+	private:
+		explicit Generator(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+		static void Advance(std::coroutine_handle<promise_type> h)
+		{
+			h.resume();
+			if (h.promise().error) std::rethrow_exception(h.promise().error);
+		}
+
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	// время в целых долях часа (1/65536 ч) для сумм первых трех алгоритмов.
+	// каждое время округляется один раз, а целые суммы не зависят от порядка
+	// сложения, поэтому последовательный проход и спуск по дереву с суммами
+	// в поддеревьях выбирают одни и те же места. Времена больше 2^24 ч
+	// (в любом случае больше любого бюджета) ограничиваются, чтобы суммы
+	// не переполнялись
+	using GreedyTime = int64_t;
+	constexpr double GREEDY_TIME_SCALE = 65536.0;
+	inline GreedyTime ToGreedyTime(float time)
+	{
+		constexpr double LIMIT = double(1 << 24);
+		return static_cast<GreedyTime>(std::llround(std::clamp(double(time), -LIMIT, LIMIT) * GREEDY_TIME_SCALE));
 	}
 
-	// второй алгоритм
-	Route VisitByValue()
+	// компаратор кучи по указателям на места: сверху оказывается место,
+	// идущее первым по comp, при равенстве - раньше стоящее в каталоге
+	template<class Comp>
+	auto HeapOrder(Comp comp)
 	{
-		Route res;
-		float time = VISIT_TIME - SLEEP_TIME;
-		std::vector<Place> temp = places;
+		return [comp](const Place* a, const Place* b)
+		{
+			if (comp(*a, *b)) return false;
+			if (comp(*b, *a)) return true;
+			return a > b;
+		};
+	}
 
-		// та же ситуация с сортировкой, что и в первом алгоритме
-		//std::sort(temp.begin(), temp.end(), CTL);
-		std::sort(temp.begin(), temp.end(), CVG);
+	// жадное заполнение в порядке comp. Вместо полной сортировки используется
+	// куча: первое место выдается через O(n), а при ранней остановке
+	// вызывающим оставшиеся места не упорядочиваются.
+	// каталог должен существовать, пока используется генератор
+	template<class Comp>
+	Generator<Place> StreamGreedy(const std::vector<Place>& catalog, float time, Comp comp)
+	{
+		std::vector<const Place*> heap;
+		heap.reserve(catalog.size());
+		for (const auto& p : catalog) heap.push_back(&p);
+		const auto order = HeapOrder(comp);
+		std::make_heap(heap.begin(), heap.end(), order);
 
-		float accTime = 0;
-		for (const auto& p : temp)
+		// добавление мест в маршрут в пределах доступного времени
+		const GreedyTime budget = ToGreedyTime(time);
+		GreedyTime accTime = 0;
+		while (!heap.empty())
 		{
-			accTime += p.time;
-			if (accTime <= time) res.places.push_back(p);
+			std::pop_heap(heap.begin(), heap.end(), order);
+			const Place& p = *heap.back();
+			heap.pop_back();
+
+			accTime += ToGreedyTime(p.time);
+			if (accTime <= budget) co_yield p;
 			else break;
 		}
+	}
 
-		return res;
+	// первый алгоритм
+	Generator<Place> StreamMostPlaces(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		// упорядочивание по важности перед упорядочиванием по времени
+		// не влияет на результат в данном случае, однако в случае
+		// с более крупным набором данных, позволило бы увеличить
+		// совокупную важность. Равные по времени места идут в порядке каталога
+		return StreamGreedy(catalog, time, CTL);
+	}
+
+	// второй алгоритм
+	Generator<Place> StreamByValue(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		// та же ситуация с упорядочиванием, что и в первом алгоритме
+		return StreamGreedy(catalog, time, CVG);
 	}
 
 	// третий алгоритм
-	Route VisitByHourValue()
+	Generator<Place> StreamByHourValue(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		return StreamGreedy(catalog, time, CHVG);
+	}
+
+	// сборка маршрута из генератора
+	Route Collect(Generator<Place> stream)
 	{
 		Route res;
-		float time = VISIT_TIME - SLEEP_TIME;
+		for (const auto& p : stream) res.places.push_back(p);
+		return res;
+	}
 
-		// структура, которая содержит указатель на место и
-		// важность в час для данного места.
-		// использован обычный, не смарт, указатель, поскольку
-		// он non-owning. По этой же причине не требуется деструктор
-		struct PlaceHV
-		{
-			const Place*	place;
-			float			hourVal;
-		public:
-			PlaceHV(const Place& pl) : place(&pl) { hourVal = pl.value / pl.time; }
-		};
+	Route VisitMostPlaces(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		return Collect(StreamMostPlaces(catalog, time));
+	}
 
-		std::vector<PlaceHV> placesHV;
-		for (const auto& p : places) { placesHV.emplace_back(p); }
-		
-		// компаратор для сравнения важности в час
-		struct CompHVGreater
-		{
-			bool operator()(const PlaceHV& p1, const PlaceHV& p2) const { return p1.hourVal > p2.hourVal; }
-		} CHVG;
+	Route VisitByValue(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		return Collect(StreamByValue(catalog, time));
+	}
 
-		std::sort(placesHV.begin(), placesHV.end(), CHVG);
+	Route VisitByHourValue(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		return Collect(StreamByHourValue(catalog, time));
+	}
 
-		float accTime = 0;
-		for (const auto& p : placesHV)
+	// -------------
+	// точное решение (задача о рюкзаке) и инфраструктура для него
+	// -------------
+
+	// пул потоков с собственной очередью у каждого потока.
+	// задачи, созданные внутри пула, кладутся в очередь текущего потока
+	// и берутся с ее конца, а простаивающие потоки забирают работу
+	// из начала чужих очередей
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency())
 		{
-			accTime += p.place->time;
-			if (accTime <= time) res.places.push_back(*p.place);
-			else break;
+			threads = std::max(threads, 1u);
+			for (unsigned i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+			for (unsigned i = 0; i < threads; ++i)
+				workers.emplace_back([this, i](std::stop_token st) { Loop(st, i); });
 		}
 
+		unsigned Size() const { return static_cast<unsigned>(queues.size()); }
+
+		template<class F>
+		auto Submit(F&& f) -> std::future<std::invoke_result_t<F>>
+		{
+			auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(f));
+			auto res = task->get_future();
+			Post([task] { (*task)(); });
+			return res;
+		}
+
+		// добавление задачи без ожидания результата
+		void Post(std::function<void()> task)
+		{
+			const size_t idx = (current.pool == this) ? current.index : next++ % queues.size();
+			{
+				std::lock_guard lock(queues[idx]->mtx);
+				queues[idx]->tasks.push_back(std::move(task));
+			}
+			{
+				std::lock_guard lock(mtx);
+				++pending;
+			}
+			cv.notify_one();
+		}
+
+		// f(0) .. f(count - 1) на потоках пула и в вызывающем потоке.
+		// индексы разбирают по одному только уже запущенные участники,
+		// поэтому вызов не ждет свободных потоков и допустим из задачи
+		// этого же пула. Первое исключение из f передается вызывающему
+		template<class F>
+		void ForEach(size_t count, F&& f)
+		{
+			struct State
+			{
+				std::atomic<size_t>					next = 0;
+				std::atomic<size_t>					done = 0;
+				size_t								count = 0;
+				std::function<void(size_t)>			body;
+				std::mutex							mtx;
+				std::exception_ptr					error;
+			};
+			// body ссылается на стек вызывающего и выполняется только
+			// для разобранного индекса, пока вызывающий ждет завершения
+			const auto state = std::make_shared<State>();
+			state->count = count;
+			state->body = [&f](size_t i) { f(i); };
+			auto run = [](State& st)
+			{
+				for (size_t i = st.next.fetch_add(1); i < st.count; i = st.next.fetch_add(1))
+				{
+					try { st.body(i); }
+					catch (...)
+					{
+						std::lock_guard lock(st.mtx);
+						if (!st.error) st.error = std::current_exception();
+					}
+					if (st.done.fetch_add(1, std::memory_order_acq_rel) + 1 == st.count) st.done.notify_all();
+				}
+			};
+
+			for (size_t t = 1; t < std::min<size_t>(Size(), count); ++t) Post([state, run] { run(*state); });
+			run(*state);
+			for (size_t d = state->done.load(std::memory_order_acquire); d != count; d = state->done.load(std::memory_order_acquire))
+				state->done.wait(d, std::memory_order_acquire);
+			if (state->error) std::rethrow_exception(state->error);
+		}
+
+	private:
+		struct Queue
+		{
+			std::mutex							mtx;
+			std::deque<std::function<void()>>	tasks;
+		};
+
+		bool TryPop(size_t self, std::function<void()>& task)
+		{
+			for (size_t k = 0; k < queues.size(); ++k)
+			{
+				Queue& q = *queues[(self + k) % queues.size()];
+				std::lock_guard lock(q.mtx);
+				if (q.tasks.empty()) continue;
+				if (k == 0) { task = std::move(q.tasks.back()); q.tasks.pop_back(); }
+				else { task = std::move(q.tasks.front()); q.tasks.pop_front(); }
+				return true;
+			}
+			return false;
+		}
+
+		void Loop(std::stop_token st, size_t self)
+		{
+			current = { this, self };
+			while (true)
+			{
+				std::function<void()> task;
+				if (TryPop(self, task))
+				{
+					{
+						std::lock_guard lock(mtx);
+						--pending;
+					}
+					task();
+					continue;
+				}
+				std::unique_lock lock(mtx);
+				cv.wait(lock, st, [this] { return pending > 0; });
+				// при остановке пула оставшиеся задачи все равно выполняются
+				if (pending == 0) return;
+			}
+		}
+
+		struct Current
+		{
+			ThreadPool*	pool;
+			size_t		index;
+		};
+		static inline thread_local Current current;
+
+		std::vector<std::unique_ptr<Queue>>	queues;
+		std::atomic<size_t>					next = 0;
+		std::mutex							mtx;
+		std::condition_variable_any			cv;
+		size_t								pending = 0;
+		// объявлен последним, чтобы потоки завершались раньше очередей
+		std::vector<std::jthread>			workers;
+	};
+
+	// перевод времени в целое число шагов дискретизации.
+	// округление вверх, чтобы найденный маршрут гарантированно
+	// укладывался в доступное время
+	inline int ToUnits(float time) { return static_cast<int>(std::ceil(time / TIME_STEP - 1e-4f)); }
+	inline int BudgetUnits(float time) { return static_cast<int>(std::floor(time / TIME_STEP + 1e-4f)); }
+
+	// динамическое программирование по оси времени.
+	// каждая строка (одно место) зависит только от предыдущей, поэтому
+	// строку можно обновлять параллельно: ось времени делится на куски,
+	// кратные кэш-линии как для значений, так и для битов решений,
+	// и между местами нужна всего одна синхронизация.
+	// таблица битов решений позволяет восстановить оптимум
+	// для любого времени не больше заданного
+	class KnapsackTable
+	{
+	public:
+		// nullopt при отмене
+		static std::optional<KnapsackTable> Build(std::span<const int> weights, std::span<const int> values, int capacity,
+			ThreadPool* pool = nullptr, std::stop_token stop = {})
+		{
+			KnapsackTable t;
+			t.weights.assign(weights.begin(), weights.end());
+			t.capacity = std::max(capacity, -1);
+			t.rowWords = (static_cast<size_t>(t.capacity) + 1 + 63) / 64;
+			if (weights.empty() || capacity < 0) return t;
+			if (!t.Fill(values, pool, stop)) return std::nullopt;
+			return t;
+		}
+
+		int Capacity() const { return capacity; }
+
+		// индексы мест оптимального маршрута для времени capacity <= Capacity()
+		std::vector<size_t> Select(int capacity) const
+		{
+			std::vector<size_t> res;
+			if (capacity < 0 || keep.empty()) return res;
+			size_t w = static_cast<size_t>(std::min(capacity, this->capacity));
+			for (size_t i = weights.size(); i-- > 0;)
+			{
+				if (keep[i * rowWords + w / 64] >> (w % 64) & 1)
+				{
+					res.push_back(i);
+					w -= static_cast<size_t>(weights[i]);
+				}
+			}
+			std::reverse(res.begin(), res.end());
+			return res;
+		}
+
+	private:
+		bool Fill(std::span<const int> values, ThreadPool* pool, std::stop_token stop);
+
+		std::vector<int>		weights;
+		int						capacity = -1;
+		size_t					rowWords = 0;
+		std::vector<uint64_t>	keep;
+	};
+
+	bool KnapsackTable::Fill(std::span<const int> values, ThreadPool* pool, std::stop_token stop)
+	{
+		const size_t n = weights.size();
+
+		// 512 элементов - это 32 кэш-линии int и ровно одна кэш-линия битов
+		constexpr size_t CHUNK = 512;
+		const size_t width = static_cast<size_t>(capacity) + 1;
+
+		std::vector<int> rowA(width, 0), rowB(width, 0);
+		keep.assign(n * rowWords, 0);
+		int* src = rowA.data();
+		int* dst = rowB.data();
+		size_t item = 0;
+		bool cancelled = false;
+
+		const unsigned team = pool ? pool->Size() : 1;
+		const size_t chunks = (width + CHUNK - 1) / CHUNK;
+		const size_t perThread = (chunks + team - 1) / team;
+
+		// обновление куска строки [lo, hi) для текущего места
+		auto updateRange = [&](size_t lo, size_t hi)
+		{
+			const size_t wi = static_cast<size_t>(weights[item]);
+			const int vi = values[item];
+			uint64_t* bits = keep.data() + item * rowWords;
+			for (size_t word = lo / 64; word * 64 < hi; ++word)
+			{
+				uint64_t mask = 0;
+				const size_t end = std::min(hi, word * 64 + 64);
+				for (size_t w = word * 64; w < end; ++w)
+				{
+					int best = src[w];
+					if (w >= wi && src[w - wi] + vi > best)
+					{
+						best = src[w - wi] + vi;
+						mask |= uint64_t(1) << (w - word * 64);
+					}
+					dst[w] = best;
+				}
+				bits[word] = mask;
+			}
+		};
+
+		if (team == 1)
+		{
+			for (item = 0; item < n && !cancelled; ++item)
+			{
+				updateRange(0, width);
+				std::swap(src, dst);
+				cancelled = stop.stop_requested();
+			}
+		}
+		else
+		{
+			// строка делится на team блоков, их разбирают вызывающий поток
+			// и задачи пула по мере запуска. Вызывающий поток может пройти
+			// все строки сам, поэтому Fill не ждет свободных потоков пула
+			// и допустим из задачи этого же пула.
+			// ticket - номер строки в старших 32 битах и следующий свободный
+			// блок в младших. Поток, завершивший последний блок строки, меняет
+			// строки местами, проверяет отмену и открывает следующую строку.
+			// run и nextRow ссылаются на стек вызывающего и выполняются только
+			// для разобранного блока, пока вызывающий не увидел FINISHED
+			struct Shared
+			{
+				std::atomic<uint64_t>			ticket = 0;
+				std::atomic<unsigned>			done = 0;
+				unsigned						blocks = 0;
+				std::function<void(size_t)>		run;
+				std::function<bool()>			nextRow;
+			};
+			constexpr uint64_t FINISHED = ~uint64_t(0);
+			constexpr uint64_t BLOCK_MASK = 0xFFFFFFFF;
+
+			const auto shared = std::make_shared<Shared>();
+			shared->blocks = team;
+			shared->run = [&](size_t t)
+			{
+				const size_t lo = std::min(width, t * perThread * CHUNK);
+				const size_t hi = std::min(width, (t + 1) * perThread * CHUNK);
+				if (lo < hi) updateRange(lo, hi);
+			};
+			shared->nextRow = [&]
+			{
+				std::swap(src, dst);
+				++item;
+				cancelled = stop.stop_requested();
+				return item < n && !cancelled;
+			};
+
+			auto participate = [](Shared& sh)
+			{
+				for (uint64_t t = sh.ticket.load(std::memory_order_acquire); t != FINISHED;)
+				{
+					if ((t & BLOCK_MASK) >= sh.blocks)
+					{
+						sh.ticket.wait(t, std::memory_order_acquire);
+						t = sh.ticket.load(std::memory_order_acquire);
+						continue;
+					}
+					if (!sh.ticket.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel, std::memory_order_acquire)) continue;
+					sh.run(static_cast<size_t>(t & BLOCK_MASK));
+					if (sh.done.fetch_add(1, std::memory_order_acq_rel) + 1 == sh.blocks)
+					{
+						sh.done.store(0, std::memory_order_relaxed);
+						sh.ticket.store(sh.nextRow() ? ((t >> 32) + 1) << 32 : FINISHED, std::memory_order_release);
+						sh.ticket.notify_all();
+					}
+					t = sh.ticket.load(std::memory_order_acquire);
+				}
+			};
+
+			for (unsigned t = 1; t < team; ++t) pool->Post([shared, participate] { participate(*shared); });
+			participate(*shared);
+		}
+		if (cancelled) keep.clear();
+		return !cancelled;
+	}
+
+	// возвращает индексы выбранных мест или nullopt при отмене
+	std::optional<std::vector<size_t>> SolveKnapsackDP(std::span<const int> weights, std::span<const int> values, int capacity,
+		ThreadPool* pool = nullptr, std::stop_token stop = {})
+	{
+		const auto table = KnapsackTable::Build(weights, values, capacity, pool, stop);
+		if (!table) return std::nullopt;
+		return table->Select(capacity);
+	}
+
+	// четвертый алгоритм - точный оптимум по суммарной важности.
+	// при threads > 1 строки ДП обновляются параллельно
+	Route VisitOptimal(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME, unsigned threads = 1)
+	{
+		std::vector<int> weights, values;
+		for (const auto& p : catalog)
+		{
+			weights.push_back(ToUnits(p.time));
+			values.push_back(p.value);
+		}
+
+		std::unique_ptr<ThreadPool> pool;
+		if (threads > 1) pool = std::make_unique<ThreadPool>(threads);
+
+		// без токена отмены решение всегда доводится до конца
+		const std::vector<size_t> selected = *SolveKnapsackDP(weights, values, BudgetUnits(time), pool.get());
+
+		Route res;
+		for (size_t i : selected)
+			res.places.push_back(catalog[i]);
+		return res;
+	}
+
+	// метод ветвей и границ по порядку важности в час.
+	// верхняя граница - дробное (жадное) решение по оставшимся местам.
+	// ветви исключения мест на верхних уровнях дерева отдаются в пул
+	// как отдельные задачи, лучшее найденное значение общее для всех потоков.
+	// в детерминированном режиме из равных по важности решений выбирается
+	// лексикографически наибольшее в порядке важности в час, поэтому
+	// ответ не зависит от числа потоков.
+	// shared - лучшее значение, найденное другими алгоритмами. Если решение
+	// не лучше него, результат пуст, а завершенный поиск доказывает его оптимальность
+	class BranchAndBound
+	{
+	public:
+		BranchAndBound(std::span<const int> weights, std::span<const int> values, int capacity, bool deterministic,
+			std::stop_token stop = {}, const std::atomic<int>* shared = nullptr)
+			: capacity(capacity), deterministic(deterministic), stop(stop), shared(shared)
+		{
+			for (size_t i = 0; i < weights.size(); ++i)
+				if (weights[i] <= capacity) order.push_back(i);
+
+			// сравнение v1/w1 > v2/w2 без деления, места без времени идут первыми
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+				{ return int64_t(values[a]) * weights[b] > int64_t(values[b]) * weights[a]; });
+
+			for (size_t i : order)
+			{
+				w.push_back(weights[i]);
+				v.push_back(values[i]);
+			}
+			prefW.assign(order.size() + 1, 0);
+			prefV.assign(order.size() + 1, 0);
+			for (size_t k = 0; k < order.size(); ++k)
+			{
+				prefW[k + 1] = prefW[k] + w[k];
+				prefV[k + 1] = prefV[k] + v[k];
+			}
+		}
+
+		std::vector<size_t> Solve(unsigned threads = 1)
+		{
+			std::vector<char> taken(order.size(), 0);
+			if (threads <= 1)
+			{
+				Search(0, capacity, 0, taken, nullptr);
+			}
+			else
+			{
+				// ветвление на верхних уровнях дает с запасом задач на каждый поток
+				ThreadPool pool(threads);
+				splitDepth = static_cast<size_t>(std::bit_width(threads)) + 8;
+				Spawn(pool, 0, capacity, 0, std::move(taken));
+				for (size_t left = outstanding.load(); left != 0; left = outstanding.load())
+					outstanding.wait(left);
+			}
+
+			std::vector<size_t> res;
+			for (size_t k = 0; k < bestTaken.size(); ++k)
+				if (bestTaken[k]) res.push_back(order[k]);
+			std::sort(res.begin(), res.end());
+			return res;
+		}
+
+		// false, если поиск был прерван и оптимальность не доказана
+		bool Complete() const { return !interrupted.load(); }
+
+		// граница дробного решения для всего каталога
+		double UpperBound() const { return Bound(0, capacity, 0); }
+
+	private:
+		// дробная верхняя граница для мест начиная с k
+		double Bound(size_t k, int cap, int val) const
+		{
+			const size_t j = std::upper_bound(prefW.begin() + k, prefW.end(), prefW[k] + cap) - prefW.begin() - 1;
+			double bound = val + double(prefV[j] - prefV[k]);
+			if (j < w.size()) bound += double(cap - (prefW[j] - prefW[k])) * v[j] / w[j];
+			return bound;
+		}
+
+		bool Prune(double bound) const
+		{
+			const int64_t reach = static_cast<int64_t>(std::floor(bound + 1e-9));
+			int best = bestValue.load(std::memory_order_relaxed);
+			if (shared) best = std::max(best, shared->load(std::memory_order_relaxed));
+			return deterministic ? reach < best : reach <= best;
+		}
+
+		void Offer(int val, const std::vector<char>& taken)
+		{
+			if (val < bestValue.load(std::memory_order_relaxed)) return;
+			if (shared && val <= shared->load(std::memory_order_relaxed)) return;
+			std::lock_guard lock(bestMtx);
+			const int best = bestValue.load(std::memory_order_relaxed);
+			if (val > best || (val == best && (bestTaken.empty() || (deterministic && taken > bestTaken))))
+			{
+				bestTaken = taken;
+				bestValue.store(val, std::memory_order_relaxed);
+			}
+		}
+
+		void Spawn(ThreadPool& pool, size_t k, int cap, int val, std::vector<char> taken)
+		{
+			outstanding.fetch_add(1);
+			pool.Post([this, &pool, k, cap, val, taken = std::move(taken)]() mutable
+				{
+					Search(k, cap, val, taken, &pool);
+					if (outstanding.fetch_sub(1) == 1) outstanding.notify_all();
+				});
+		}
+
+		void Search(size_t k, int cap, int val, std::vector<char>& taken, ThreadPool* pool)
+		{
+			if (stop.stop_requested())
+			{
+				interrupted.store(true, std::memory_order_relaxed);
+				return;
+			}
+			if (k == w.size())
+			{
+				Offer(val, taken);
+				return;
+			}
+			if (Prune(Bound(k, cap, val))) return;
+
+			// ветвь исключения на верхних уровнях уходит в пул
+			const bool split = pool && k < splitDepth;
+			if (split)
+			{
+				std::vector<char> rest = taken;
+				rest[k] = 0;
+				Spawn(*pool, k + 1, cap, val, std::move(rest));
+			}
+			if (w[k] <= cap)
+			{
+				taken[k] = 1;
+				Search(k + 1, cap - w[k], val + v[k], taken, pool);
+				taken[k] = 0;
+			}
+			if (!split) Search(k + 1, cap, val, taken, pool);
+		}
+
+		int						capacity;
+		bool					deterministic;
+		std::stop_token			stop;
+		const std::atomic<int>*	shared;
+		size_t					splitDepth = 0;
+		std::vector<size_t>		order;
+		std::vector<int>		w, v;
+		std::vector<int64_t>	prefW, prefV;
+
+		std::atomic<int>		bestValue = 0;
+		std::mutex				bestMtx;
+		std::vector<char>		bestTaken;
+		std::atomic<size_t>		outstanding = 0;
+		std::atomic<bool>		interrupted = false;
+	};
+
+	// пятый алгоритм - точный оптимум методом ветвей и границ
+	Route VisitBranchAndBound(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME,
+		unsigned threads = 1, bool deterministic = false)
+	{
+		std::vector<int> weights, values;
+		for (const auto& p : catalog)
+		{
+			weights.push_back(ToUnits(p.time));
+			values.push_back(p.value);
+		}
+
+		Route res;
+		for (size_t i : BranchAndBound(weights, values, BudgetUnits(time), deterministic).Solve(threads))
+			res.places.push_back(catalog[i]);
+		return res;
+	}
+
+	// индексы мест, выбранных третьим алгоритмом, во времени в шагах дискретизации
+	std::vector<size_t> GreedyByHourValue(std::span<const int> weights, std::span<const int> values, int capacity)
+	{
+		std::vector<size_t> order(weights.size());
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+			{ return int64_t(values[a]) * weights[b] > int64_t(values[b]) * weights[a]; });
+
+		std::vector<size_t> res;
+		int used = 0;
+		for (size_t i : order)
+		{
+			used += weights[i];
+			if (used <= capacity) res.push_back(i);
+			else break;
+		}
+		return res;
+	}
+
+	// локальный поиск: добавляет помещающиеся места и заменяет одно
+	// место другим, пока это увеличивает суммарную важность
+	std::vector<size_t> ImproveLocally(std::span<const int> weights, std::span<const int> values, int capacity,
+		std::vector<size_t> start, std::stop_token stop = {})
+	{
+		const size_t n = weights.size();
+		std::vector<char> in(n, 0);
+		int used = 0;
+		for (size_t i : start)
+		{
+			in[i] = 1;
+			used += weights[i];
+		}
+
+		for (bool improved = true; improved && !stop.stop_requested();)
+		{
+			improved = false;
+
+			// добавление самого важного из помещающихся мест
+			size_t add = n;
+			for (size_t j = 0; j < n; ++j)
+				if (!in[j] && used + weights[j] <= capacity && (add == n || values[j] > values[add])) add = j;
+			if (add != n && values[add] > 0)
+			{
+				in[add] = 1;
+				used += weights[add];
+				improved = true;
+				continue;
+			}
+
+			// замена с наибольшим приростом важности
+			size_t out = n, into = n;
+			int gain = 0;
+			for (size_t i = 0; i < n && !stop.stop_requested(); ++i)
+			{
+				if (!in[i]) continue;
+				for (size_t j = 0; j < n; ++j)
+				{
+					if (in[j] || used - weights[i] + weights[j] > capacity) continue;
+					if (values[j] - values[i] > gain)
+					{
+						gain = values[j] - values[i];
+						out = i;
+						into = j;
+					}
+				}
+			}
+			if (out != n)
+			{
+				in[out] = 0;
+				in[into] = 1;
+				used += weights[into] - weights[out];
+				improved = true;
+			}
+		}
+
+		std::vector<size_t> res;
+		for (size_t i = 0; i < n; ++i)
+			if (in[i]) res.push_back(i);
+		return res;
+	}
+
+	// шестой алгоритм - локальный поиск, начинающий с ответа третьего
+	Route VisitLocalSearch(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME, std::stop_token stop = {})
+	{
+		std::vector<int> weights, values;
+		for (const auto& p : catalog)
+		{
+			weights.push_back(ToUnits(p.time));
+			values.push_back(p.value);
+		}
+		const int capacity = BudgetUnits(time);
+
+		Route res;
+		for (size_t i : ImproveLocally(weights, values, capacity, GreedyByHourValue(weights, values, capacity), stop))
+			res.places.push_back(catalog[i]);
+		return res;
+	}
+
+	// -------------
+	// одновременный запуск нескольких алгоритмов
+	// -------------
+
+	enum class Strategy
+	{
+		MostPlaces,
+		ByValue,
+		ByHourValue,
+		LocalSearch,
+		Optimal,
+		BranchAndBound
+	};
+
+	constexpr Strategy ALL_STRATEGIES[] =
+	{
+		Strategy::MostPlaces, Strategy::ByValue, Strategy::ByHourValue,
+		Strategy::LocalSearch, Strategy::Optimal, Strategy::BranchAndBound
+	};
+
+	constexpr std::string_view StrategyName(Strategy s)
+	{
+		switch (s)
+		{
+		case Strategy::MostPlaces:		return "VisitMostPlaces";
+		case Strategy::ByValue:			return "VisitByValue";
+		case Strategy::ByHourValue:		return "VisitByHourValue";
+		case Strategy::LocalSearch:		return "VisitLocalSearch";
+		case Strategy::Optimal:			return "VisitOptimal";
+		case Strategy::BranchAndBound:	return "VisitBranchAndBound";
+		}
+		return {};
+	}
+
+	// лучший маршрут, найденный одновременно работающими алгоритмами.
+	// значение доступно без блокировки, чтобы точные алгоритмы
+	// могли отсекать по нему ветви
+	class Incumbent
+	{
+	public:
+		bool Offer(Route r)
+		{
+			const int v = r.TotalValue();
+			std::lock_guard lock(mtx);
+			if (v <= value.load()) return false;
+			route = std::move(r);
+			value.store(v);
+			return true;
+		}
+
+		Route Get() const
+		{
+			std::lock_guard lock(mtx);
+			return route;
+		}
+
+		const std::atomic<int>& Value() const { return value; }
+
+	private:
+		mutable std::mutex	mtx;
+		Route				route;
+		std::atomic<int>	value = std::numeric_limits<int>::min();
+	};
+
+	// запуск одного алгоритма. Возвращает true, если его результат
+	// доказанно оптимален и остальные алгоритмы можно отменить
+	bool RunStrategy(Strategy s, const std::vector<Place>& catalog, float time, Incumbent& best, std::stop_token stop)
+	{
+		std::vector<int> weights, values;
+		for (const auto& p : catalog)
+		{
+			weights.push_back(ToUnits(p.time));
+			values.push_back(p.value);
+		}
+		auto toRoute = [&](const std::vector<size_t>& selected)
+		{
+			Route r;
+			for (size_t i : selected) r.places.push_back(catalog[i]);
+			return r;
+		};
+
+		switch (s)
+		{
+		case Strategy::MostPlaces:		best.Offer(VisitMostPlaces(catalog, time)); return false;
+		case Strategy::ByValue:			best.Offer(VisitByValue(catalog, time)); return false;
+		case Strategy::ByHourValue:		best.Offer(VisitByHourValue(catalog, time)); return false;
+		case Strategy::LocalSearch:		best.Offer(VisitLocalSearch(catalog, time, stop)); return false;
+		case Strategy::Optimal:
+		{
+			const auto selected = SolveKnapsackDP(weights, values, BudgetUnits(time), nullptr, stop);
+			if (!selected) return false;
+			best.Offer(toRoute(*selected));
+			return true;
+		}
+		case Strategy::BranchAndBound:
+		{
+			BranchAndBound bb(weights, values, BudgetUnits(time), false, stop, &best.Value());
+			const auto selected = bb.Solve();
+			if (!selected.empty()) best.Offer(toRoute(selected));
+			return bb.Complete();
+		}
+		}
+		return false;
+	}
+
+	// маршрут одного алгоритма, выбранного во время выполнения.
+	// при отмене через stop возвращается лучший найденный к этому моменту
+	Route Plan(Strategy s, const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME, std::stop_token stop = {})
+	{
+		Incumbent best;
+		RunStrategy(s, catalog, time, best, stop);
+		return best.Get();
+	}
+
+	// -------------
+	// обязательные и исключенные места
+	// -------------
+
+	// ограничения на состав маршрута, индексы мест в каталоге
+	struct Constraints
+	{
+		std::vector<size_t>	mandatory;
+		std::vector<size_t>	forbidden;
+
+		bool Empty() const { return mandatory.empty() && forbidden.empty(); }
+	};
+
+	// задача без ограничений, к которой они сводятся: обязательные места
+	// уже в маршруте и их время вычтено из бюджета, а обязательные
+	// и исключенные места убраны из каталога
+	struct ReducedProblem
+	{
+		Route				fixed;
+		std::vector<Place>	catalog;
+		float				time;
+	};
+
+	// nullopt, если обязательные места не помещаются во время
+	std::optional<ReducedProblem> Reduce(const Constraints& c, const std::vector<Place>& catalog = places,
+		float time = VISIT_TIME - SLEEP_TIME)
+	{
+		std::vector<char> state(catalog.size(), 0);
+		for (size_t i : c.forbidden)
+		{
+			if (i >= catalog.size()) throw std::out_of_range("place index out of range");
+			state[i] = 2;
+		}
+		ReducedProblem r;
+		// время обязательных мест округляется так же, как в точных алгоритмах
+		int units = 0;
+		for (size_t i : c.mandatory)
+		{
+			if (i >= catalog.size()) throw std::out_of_range("place index out of range");
+			if (state[i] == 2) throw std::invalid_argument(std::format("place {} is both mandatory and forbidden", i));
+			if (state[i] == 1) continue;
+			state[i] = 1;
+			units += ToUnits(catalog[i].time);
+			r.fixed.places.push_back(catalog[i]);
+		}
+		r.time = time - units * TIME_STEP;
+		if (r.time < 0) return std::nullopt;
+
+		r.catalog.reserve(catalog.size());
+		for (size_t i = 0; i < catalog.size(); ++i)
+			if (!state[i]) r.catalog.push_back(catalog[i]);
+		return r;
+	}
+
+	// маршрут из обязательных мест и ответа алгоритма на сведенную задачу
+	Route Complete(ReducedProblem&& problem, const Route& rest)
+	{
+		Route r = std::move(problem.fixed);
+		r.places.insert(r.places.end(), rest.places.begin(), rest.places.end());
+		return r;
+	}
+
+	// исключение invalid_argument, если обязательные места не помещаются
+	Route Plan(Strategy s, const Constraints& c, const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		if (c.Empty()) return Plan(s, catalog, time);
+		auto problem = Reduce(c, catalog, time);
+		if (!problem) throw std::invalid_argument("mandatory places exceed the time budget");
+		const Route rest = Plan(s, problem->catalog, problem->time);
+		return Complete(std::move(*problem), rest);
+	}
+
+	// -------------
+	// бюджет на билеты
+	// -------------
+
+	// эффективность места при двух ограничениях: важность на долю обоих
+	// бюджетов, которую оно занимает
+	double Efficiency(const Place& p, float time, int money)
+	{
+		const double share = p.time / std::max(time, TIME_STEP) + (money > 0 ? double(p.cost) / money : (p.cost ? 1e9 : 0));
+		return p.value / share;
+	}
+
+	// дозаполнение маршрута (выбранные места отмечены в taken) местами
+	// в порядке эффективности. В отличие от третьего алгоритма, место,
+	// не помещающееся по одному из бюджетов, пропускается
+	void FillByEfficiency(const std::vector<Place>& catalog, float time, int money, std::vector<char>& taken)
+	{
+		float accTime = 0;
+		int accCost = 0;
+		std::vector<size_t> order;
+		for (size_t i = 0; i < catalog.size(); ++i)
+		{
+			if (taken[i])
+			{
+				accTime += catalog[i].time;
+				accCost += catalog[i].cost;
+			}
+			else order.push_back(i);
+		}
+		std::vector<double> score(catalog.size());
+		for (size_t i : order) score[i] = Efficiency(catalog[i], time, money);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return score[a] > score[b]; });
+
+		for (size_t i : order)
+		{
+			if (accTime + catalog[i].time > time || accCost + catalog[i].cost > money) continue;
+			accTime += catalog[i].time;
+			accCost += catalog[i].cost;
+			taken[i] = 1;
+		}
+	}
+
+	Route FromMask(const std::vector<Place>& catalog, const std::vector<char>& taken)
+	{
+		Route r;
+		for (size_t i = 0; i < catalog.size(); ++i)
+			if (taken[i]) r.places.push_back(catalog[i]);
+		return r;
+	}
+
+	// третий алгоритм с учетом бюджета на билеты
+	Route VisitByEfficiency(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME, int money = MONEY_BUDGET)
+	{
+		std::vector<char> taken(catalog.size(), 0);
+		if (time >= 0 && money >= 0) FillByEfficiency(catalog, time, money, taken);
+		return FromMask(catalog, taken);
+	}
+
+	// наибольший общий делитель стоимостей, 0 если все места бесплатны.
+	// стоимости и бюджет делятся на него без изменения оптимума:
+	// обычно цены кратны десяткам или сотням рублей
+	int CostScale(const std::vector<Place>& catalog)
+	{
+		int g = 0;
+		for (const auto& p : catalog) g = std::gcd(g, p.cost);
+		return g;
+	}
+
+	// точный оптимум по времени и деньгам: ДП по парам (время, деньги)
+	// с битами выбора по каждому месту. Деньги считаются в единицах CostScale
+	Route SolveBudgetDP(const std::vector<Place>& catalog, float time, int money)
+	{
+		const int capacity = BudgetUnits(time);
+		if (capacity < 0 || money < 0) return {};
+		const int scale = CostScale(catalog);
+		const int budget = scale ? money / scale : 0;
+		auto units = [scale](int cost) { return scale ? cost / scale : 0; };
+		const size_t stride = static_cast<size_t>(budget) + 1;
+		const size_t states = (static_cast<size_t>(capacity) + 1) * stride;
+		const size_t words = (states + 63) / 64;
+
+		std::vector<int> best(states, 0);
+		std::vector<uint64_t> keep(catalog.size() * words, 0);
+		for (size_t i = 0; i < catalog.size(); ++i)
+		{
+			const int wi = ToUnits(catalog[i].time), ci = units(catalog[i].cost), vi = catalog[i].value;
+			if (wi > capacity || ci > budget) continue;
+			uint64_t* bits = keep.data() + i * words;
+			// строки по времени сверху вниз: источник (w - wi) еще не обновлен
+			for (int w = capacity; w >= wi; --w)
+			{
+				int* dst = best.data() + static_cast<size_t>(w) * stride;
+				const int* src = best.data() + static_cast<size_t>(w - wi) * stride;
+				for (size_t m = static_cast<size_t>(ci); m < stride; ++m)
+				{
+					if (src[m - ci] + vi > dst[m])
+					{
+						dst[m] = src[m - ci] + vi;
+						const size_t s = static_cast<size_t>(w) * stride + m;
+						bits[s / 64] |= uint64_t(1) << (s % 64);
+					}
+				}
+			}
+		}
+
+		std::vector<char> taken(catalog.size(), 0);
+		size_t w = static_cast<size_t>(capacity), m = static_cast<size_t>(budget);
+		for (size_t i = catalog.size(); i-- > 0;)
+		{
+			const size_t s = w * stride + m;
+			if (keep[i * words + s / 64] >> (s % 64) & 1)
+			{
+				taken[i] = 1;
+				w -= static_cast<size_t>(ToUnits(catalog[i].time));
+				m -= static_cast<size_t>(units(catalog[i].cost));
+			}
+		}
+		return FromMask(catalog, taken);
+	}
+
+	// результат лагранжевой релаксации: лучший найденный маршрут
+	// и верхняя граница оптимума
+	struct LagrangianResult
+	{
+		Route	route;
+		double	upperBound;
+	};
+
+	// релаксация бюджета на билеты с множителем lambda: задача сводится к
+	// рюкзаку только по времени с важностью v - lambda * c, lambda
+	// подбирается субградиентным методом. Решение релаксации, нарушающее
+	// бюджет, исправляется удалением мест с наименьшей важностью на рубль
+	// и дозаполнением по эффективности
+	LagrangianResult SolveBudgetLagrangian(const std::vector<Place>& catalog, float time, int money, int iterations = 100)
+	{
+		const int capacity = BudgetUnits(time);
+		if (capacity < 0 || money < 0) return { {}, 0 };
+		const size_t n = catalog.size();
+		const size_t width = static_cast<size_t>(capacity) + 1;
+		const size_t words = (width + 63) / 64;
+
+		std::vector<int> weights(n);
+		for (size_t i = 0; i < n; ++i) weights[i] = ToUnits(catalog[i].time);
+
+		std::vector<double> row(width);
+		std::vector<uint64_t> keep(n * words);
+		std::vector<char> taken(n), bestTaken(n, 0);
+		int bestValue = 0;
+		double upper = std::numeric_limits<double>::infinity();
+		double lambda = 0, theta = 2;
+		int stall = 0;
+
+		for (int it = 0; it < iterations; ++it)
+		{
+			std::fill(row.begin(), row.end(), 0.0);
+			std::fill(keep.begin(), keep.end(), 0);
+			for (size_t i = 0; i < n; ++i)
+			{
+				const double vi = catalog[i].value - lambda * catalog[i].cost;
+				if (vi <= 0 || weights[i] > capacity || catalog[i].cost > money) continue;
+				uint64_t* bits = keep.data() + i * words;
+				for (size_t w = width; w-- > static_cast<size_t>(weights[i]);)
+				{
+					if (row[w - weights[i]] + vi > row[w])
+					{
+						row[w] = row[w - weights[i]] + vi;
+						bits[w / 64] |= uint64_t(1) << (w % 64);
+					}
+				}
+			}
+
+			std::fill(taken.begin(), taken.end(), 0);
+			long long cost = 0;
+			for (size_t i = n, w = width - 1; i-- > 0;)
+			{
+				if (keep[i * words + w / 64] >> (w % 64) & 1)
+				{
+					taken[i] = 1;
+					cost += catalog[i].cost;
+					w -= static_cast<size_t>(weights[i]);
+				}
+			}
+			const double bound = row[width - 1] + lambda * money;
+			if (bound < upper - 1e-9) stall = 0;
+			else if (++stall % 10 == 0) theta /= 2;
+			upper = std::min(upper, bound);
+
+			// восстановление допустимости: сначала уходят места
+			// с наименьшей важностью на рубль
+			std::vector<size_t> chosen;
+			for (size_t i = 0; i < n; ++i) if (taken[i]) chosen.push_back(i);
+			std::sort(chosen.begin(), chosen.end(), [&](size_t a, size_t b)
+				{
+					return double(catalog[a].value) * catalog[b].cost < double(catalog[b].value) * catalog[a].cost;
+				});
+			long long repaired = cost;
+			for (size_t k = 0; k < chosen.size() && repaired > money; ++k)
+			{
+				taken[chosen[k]] = 0;
+				repaired -= catalog[chosen[k]].cost;
+			}
+			FillByEfficiency(catalog, time, money, taken);
+
+			int value = 0;
+			for (size_t i = 0; i < n; ++i) if (taken[i]) value += catalog[i].value;
+			if (value > bestValue)
+			{
+				bestValue = value;
+				bestTaken = taken;
+			}
+
+			// важность целая, поэтому совпадение с округленной вниз
+			// границей доказывает оптимальность
+			const double gradient = double(money) - double(cost);
+			if (bestValue >= std::floor(upper + 1e-9) || (gradient >= 0 && lambda * gradient == 0)) break;
+			lambda = std::max(0.0, lambda - theta * (upper - bestValue) / (gradient * gradient) * gradient);
+		}
+		return { FromMask(catalog, bestTaken), upper };
+	}
+
+	// лучший маршрут при ограничениях и по времени, и по деньгам.
+	// точная ДП, если ее таблица выбора умещается в BUDGET_DP_BITS бит,
+	// а таблица значений - в BUDGET_DP_STATES состояний, иначе лагранжева релаксация
+	constexpr size_t BUDGET_DP_BITS = size_t(1) << 28;
+	constexpr size_t BUDGET_DP_STATES = size_t(1) << 24;
+
+	Route VisitWithinBudget(const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME, int money = MONEY_BUDGET)
+	{
+		const int capacity = BudgetUnits(time);
+		if (capacity < 0 || money < 0) return {};
+		const int scale = CostScale(catalog);
+		const double states = (capacity + 1.0) * ((scale ? money / scale : 0) + 1.0);
+		if (states <= double(BUDGET_DP_STATES) && double(catalog.size()) * states <= double(BUDGET_DP_BITS))
+			return SolveBudgetDP(catalog, time, money);
+		return SolveBudgetLagrangian(catalog, time, money).route;
+	}
+
+	// -------------
+	// несколько вариантов посещения
+	// -------------
+
+	// вариант посещения: то же место можно осмотреть быстрее с меньшей
+	// важностью или дольше с большей
+	struct VisitOption
+	{
+		float	time;
+		int		value;
+		int		cost = 0;
+	};
+
+	struct FlexiblePlace
+	{
+		std::string					name;
+		std::vector<VisitOption>	options;
+	};
+
+	// места с одинаковыми названиями становятся вариантами одного места,
+	// порядок - по первому появлению в каталоге
+	std::vector<FlexiblePlace> GroupByName(const std::vector<Place>& catalog = places)
+	{
+		std::vector<FlexiblePlace> res;
+		std::unordered_map<std::string_view, size_t> index;
+		index.reserve(catalog.size());
+		for (const auto& p : catalog)
+		{
+			const auto [it, added] = index.emplace(p.name, res.size());
+			if (added) res.push_back({ p.name, {} });
+			res[it->second].options.push_back({ p.time, p.value, p.cost });
+		}
+		return res;
+	}
+
+	// маршрут и выбранные варианты: choices[k] - (индекс места в каталоге,
+	// индекс варианта) для route.places[k]
+	struct MultiChoiceRoute
+	{
+		Route									route;
+		std::vector<std::pair<size_t, size_t>>	choices;
+
+		void Add(const std::vector<FlexiblePlace>& catalog, size_t place, size_t option)
+		{
+			const VisitOption& o = catalog[place].options[option];
+			route.places.push_back({ catalog[place].name, o.time, o.value, o.cost });
+			choices.emplace_back(place, option);
+		}
+	};
+
+	// точный оптимум: ДП по времени, в которой у каждого места берется
+	// не больше одного варианта. O(W) на вариант, для восстановления
+	// хранится номер выбранного варианта для каждого места и времени
+	MultiChoiceRoute SolveMultiChoiceDP(const std::vector<FlexiblePlace>& catalog, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		MultiChoiceRoute res;
+		const int capacity = BudgetUnits(time);
+		if (capacity < 0) return res;
+		const size_t width = static_cast<size_t>(capacity) + 1;
+
+		std::vector<int> prev(width, 0), cur(width);
+		// 0 - место пропущено, иначе номер варианта + 1
+		std::vector<uint32_t> choice(catalog.size() * width, 0);
+		for (size_t g = 0; g < catalog.size(); ++g)
+		{
+			cur = prev;
+			uint32_t* row = choice.data() + g * width;
+			for (size_t j = 0; j < catalog[g].options.size(); ++j)
+			{
+				const size_t wj = static_cast<size_t>(ToUnits(catalog[g].options[j].time));
+				const int vj = catalog[g].options[j].value;
+				for (size_t w = wj; w < width; ++w)
+				{
+					if (prev[w - wj] + vj > cur[w])
+					{
+						cur[w] = prev[w - wj] + vj;
+						row[w] = static_cast<uint32_t>(j + 1);
+					}
+				}
+			}
+			std::swap(prev, cur);
+		}
+
+		size_t w = width - 1;
+		for (size_t g = catalog.size(); g-- > 0;)
+		{
+			if (const uint32_t j = choice[g * width + w])
+			{
+				res.Add(catalog, g, j - 1);
+				w -= static_cast<size_t>(ToUnits(catalog[g].options[j - 1].time));
+			}
+		}
+		std::reverse(res.route.places.begin(), res.route.places.end());
+		std::reverse(res.choices.begin(), res.choices.end());
+		return res;
+	}
+
+	// быстрый жадный алгоритм на основе ЛП-доминирования: у каждого места
+	// остаются варианты на верхней выпуклой оболочке (время, важность),
+	// переходы между соседними вариантами оболочки - это приращения важности
+	// за приращение времени. Приращения всех мест применяются по убыванию
+	// эффективности, пока хватает времени. O(K log K) на K вариантов
+	MultiChoiceRoute VisitMultiChoiceGreedy(const std::vector<FlexiblePlace>& catalog, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		// оболочки всех мест подряд, hullStart[g] - начало оболочки места g
+		std::vector<uint32_t> hull;
+		std::vector<size_t> hullStart(catalog.size() + 1, 0);
+		std::vector<uint32_t> order;
+		for (size_t g = 0; g < catalog.size(); ++g)
+		{
+			const auto& opts = catalog[g].options;
+			order.resize(opts.size());
+			std::iota(order.begin(), order.end(), 0u);
+			std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+				{
+					return opts[a].time != opts[b].time ? opts[a].time < opts[b].time : opts[a].value > opts[b].value;
+				});
+
+			const size_t start = hull.size();
+			auto point = [&](size_t k) { return k == start ? VisitOption{ 0, 0 } : opts[hull[k - 1]]; };
+			for (uint32_t j : order)
+			{
+				const VisitOption& c = opts[j];
+				// доминирование: не дольше и не менее важно
+				if (c.value <= point(hull.size()).value) continue;
+				// ЛП-доминирование: средняя точка ниже отрезка между соседями
+				while (hull.size() > start)
+				{
+					const VisitOption a = point(hull.size() - 1), b = point(hull.size());
+					if (double(b.value - a.value) * (c.time - b.time) > double(c.value - b.value) * (b.time - a.time)) break;
+					hull.pop_back();
+				}
+				hull.push_back(j);
+			}
+			hullStart[g + 1] = hull.size();
+		}
+
+		struct Step
+		{
+			double		efficiency;
+			uint32_t	group;
+			uint32_t	to;
+		};
+		std::vector<Step> steps;
+		steps.reserve(hull.size());
+		for (size_t g = 0; g < catalog.size(); ++g)
+		{
+			const auto& opts = catalog[g].options;
+			for (size_t k = hullStart[g]; k < hullStart[g + 1]; ++k)
+			{
+				const VisitOption from = k == hullStart[g] ? VisitOption{ 0, 0 } : opts[hull[k - 1]];
+				const VisitOption& to = opts[hull[k]];
+				steps.push_back({ (to.value - from.value) / double(to.time - from.time), static_cast<uint32_t>(g), static_cast<uint32_t>(k - hullStart[g] + 1) });
+			}
+		}
+		// внутри места эффективность убывает, поэтому устойчивая сортировка
+		// сохраняет порядок приращений каждого места
+		std::stable_sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) { return a.efficiency > b.efficiency; });
+
+		// position[g] - число пройденных вариантов оболочки. После
+		// неуместившегося приращения место остается на текущем варианте
+		std::vector<uint32_t> position(catalog.size(), 0);
+		std::vector<char> closed(catalog.size(), 0);
+		float accTime = 0;
+		for (const Step& s : steps)
+		{
+			uint32_t& pos = position[s.group];
+			if (closed[s.group] || pos + 1 != s.to) continue;
+			const auto& opts = catalog[s.group].options;
+			const size_t base = hullStart[s.group];
+			const float delta = opts[hull[base + s.to - 1]].time - (pos ? opts[hull[base + pos - 1]].time : 0.0f);
+			if (accTime + delta > time)
+			{
+				closed[s.group] = 1;
+				continue;
+			}
+			accTime += delta;
+			pos = s.to;
+		}
+
+		MultiChoiceRoute res;
+		for (size_t g = 0; g < catalog.size(); ++g)
+			if (position[g]) res.Add(catalog, g, hull[hullStart[g] + position[g] - 1]);
+		return res;
+	}
+
+	// -------------
+	// категории, квоты и взаимоисключающие места
+	// -------------
+
+	// правила состава маршрута для каталога, места задаются индексами
+	struct PlaceRules
+	{
+		// категория каждого места, -1 - без категории. Пусто - категорий нет
+		std::vector<int>					category;
+		// допустимое число мест каждой категории [min, max]
+		std::vector<std::pair<int, int>>	quotas;
+		// из каждой группы выбирается не больше одного места
+		std::vector<std::vector<size_t>>	exclusive;
+	};
+
+	// счетчики выбранных мест по категориям и группам
+	class RuleState
+	{
+	public:
+		RuleState(const PlaceRules& rules, size_t size) : rules(rules), count(rules.quotas.size(), 0), used(rules.exclusive.size(), 0), groups(size)
+		{
+			if (!rules.category.empty() && rules.category.size() != size) throw std::invalid_argument("rules do not match the catalog");
+			for (int c : rules.category)
+				if (c >= static_cast<int>(rules.quotas.size())) throw std::invalid_argument(std::format("no quota for category {}", c));
+			for (size_t g = 0; g < rules.exclusive.size(); ++g)
+			{
+				for (size_t i : rules.exclusive[g])
+				{
+					if (i >= size) throw std::out_of_range("place index out of range");
+					groups[i].push_back(g);
+				}
+			}
+		}
+
+		int Category(size_t i) const { return rules.category.empty() ? -1 : rules.category[i]; }
+		int Count(int c) const { return count[c]; }
+		int Min(int c) const { return rules.quotas[c].first; }
+
+		bool CanTake(size_t i) const
+		{
+			const int c = Category(i);
+			if (c >= 0 && count[c] >= rules.quotas[c].second) return false;
+			return std::none_of(groups[i].begin(), groups[i].end(), [this](size_t g) { return used[g] != 0; });
+		}
+
+		void Take(size_t i)
+		{
+			if (const int c = Category(i); c >= 0) ++count[c];
+			for (size_t g : groups[i]) ++used[g];
+		}
+
+		void Undo(size_t i)
+		{
+			if (const int c = Category(i); c >= 0) --count[c];
+			for (size_t g : groups[i]) --used[g];
+		}
+
+		bool MinsMet() const
+		{
+			for (size_t c = 0; c < count.size(); ++c)
+				if (count[c] < rules.quotas[c].first) return false;
+			return true;
+		}
+
+	private:
+		const PlaceRules&					rules;
+		std::vector<int>					count;
+		std::vector<int>					used;
+		std::vector<std::vector<size_t>>	groups;
+	};
+
+	// порядок мест по убыванию важности в час (в единицах TIME_STEP)
+	std::vector<size_t> HourValueOrder(const std::vector<Place>& catalog, const std::vector<int>& weights)
+	{
+		std::vector<size_t> order(catalog.size());
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+			{
+				return int64_t(catalog[a].value) * weights[b] > int64_t(catalog[b].value) * weights[a];
+			});
+		return order;
+	}
+
+	// точный оптимум с правилами: ветви и границы в порядке важности в час.
+	// граница - дробный рюкзак без учета правил, ветка без места
+	// отсекается, если оставшихся мест категории не хватит до минимума.
+	// nullopt, если правила невыполнимы
+	std::optional<Route> SolveWithRules(const PlaceRules& rules, const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		const int capacity = BudgetUnits(time);
+		RuleState state(rules, catalog.size());
+		if (capacity < 0) return std::nullopt;
+
+		std::vector<int> weights(catalog.size());
+		for (size_t i = 0; i < catalog.size(); ++i) weights[i] = ToUnits(catalog[i].time);
+		const std::vector<size_t> order = HourValueOrder(catalog, weights);
+
+		// число еще не рассмотренных мест каждой категории
+		std::vector<int> remaining(rules.quotas.size(), 0);
+		for (size_t i = 0; i < catalog.size(); ++i)
+			if (const int c = state.Category(i); c >= 0) ++remaining[c];
+
+		std::vector<char> taken(catalog.size(), 0), best;
+		int bestValue = -1;
+
+		auto bound = [&](size_t k, int cap, int value)
+		{
+			double res = value;
+			for (; k < order.size(); ++k)
+			{
+				const size_t i = order[k];
+				if (weights[i] <= cap)
+				{
+					cap -= weights[i];
+					res += catalog[i].value;
+				}
+				else
+				{
+					res += double(catalog[i].value) * cap / weights[i];
+					break;
+				}
+			}
+			return res;
+		};
+
+		auto search = [&](auto& self, size_t k, int cap, int value) -> void
+		{
+			if (value > bestValue && state.MinsMet())
+			{
+				bestValue = value;
+				best = taken;
+			}
+			if (k == order.size() || std::floor(bound(k, cap, value) + 1e-9) <= bestValue) return;
+
+			const size_t i = order[k];
+			const int c = state.Category(i);
+			if (c >= 0) --remaining[c];
+			if (weights[i] <= cap && state.CanTake(i))
+			{
+				state.Take(i);
+				taken[i] = 1;
+				self(self, k + 1, cap - weights[i], value + catalog[i].value);
+				taken[i] = 0;
+				state.Undo(i);
+			}
+			if (c < 0 || state.Count(c) + remaining[c] >= state.Min(c)) self(self, k + 1, cap, value);
+			if (c >= 0) ++remaining[c];
+		};
+		search(search, 0, capacity, 0);
+
+		if (bestValue < 0) return std::nullopt;
+		Route r;
+		for (size_t i = 0; i < catalog.size(); ++i)
+			if (best[i]) r.places.push_back(catalog[i]);
+		return r;
+	}
+
+	// быстрый вариант третьего алгоритма с правилами: сначала минимумы
+	// категорий закрываются лучшими по важности в час местами категории,
+	// затем маршрут дополняется в том же порядке. Место, нарушающее
+	// правила или не помещающееся, пропускается.
+	// nullopt, если минимумы не удалось выполнить
+	std::optional<Route> VisitWithRules(const PlaceRules& rules, const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		int cap = BudgetUnits(time);
+		RuleState state(rules, catalog.size());
+		if (cap < 0) return std::nullopt;
+
+		std::vector<int> weights(catalog.size());
+		for (size_t i = 0; i < catalog.size(); ++i) weights[i] = ToUnits(catalog[i].time);
+		const std::vector<size_t> order = HourValueOrder(catalog, weights);
+
+		Route r;
+		std::vector<char> taken(catalog.size(), 0);
+		auto take = [&](size_t i)
+		{
+			if (taken[i] || weights[i] > cap || !state.CanTake(i)) return;
+			state.Take(i);
+			taken[i] = 1;
+			cap -= weights[i];
+			r.places.push_back(catalog[i]);
+		};
+
+		for (int c = 0; c < static_cast<int>(rules.quotas.size()); ++c)
+			for (size_t k = 0; k < order.size() && state.Count(c) < state.Min(c); ++k)
+				if (state.Category(order[k]) == c) take(order[k]);
+		if (!state.MinsMet()) return std::nullopt;
+
+		for (size_t i : order) take(i);
+		return r;
+	}
+
+	// -------------
+	// предшествование мест
+	// -------------
+
+	// место after посещается после места before. Если required, место after
+	// без before не имеет смысла и выбирается только вместе с ним, иначе
+	// ограничение задает только порядок, если выбраны оба
+	struct Precedence
+	{
+		size_t	before;
+		size_t	after;
+		bool	required = true;
+	};
+
+	// порядок мест, совместимый со всеми ограничениями, при равенстве -
+	// по индексу. Исключение invalid_argument при цикле
+	std::vector<size_t> TopologicalOrder(size_t size, const std::vector<Precedence>& rules)
+	{
+		std::vector<std::vector<size_t>> next(size);
+		std::vector<size_t> indegree(size, 0);
+		for (const auto& r : rules)
+		{
+			if (r.before >= size || r.after >= size) throw std::out_of_range("place index out of range");
+			next[r.before].push_back(r.after);
+			++indegree[r.after];
+		}
+		std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+		for (size_t i = 0; i < size; ++i)
+			if (!indegree[i]) ready.push(i);
+
+		std::vector<size_t> order;
+		order.reserve(size);
+		while (!ready.empty())
+		{
+			const size_t i = ready.top();
+			ready.pop();
+			order.push_back(i);
+			for (size_t j : next[i])
+				if (!--indegree[j]) ready.push(j);
+		}
+		if (order.size() != size) throw std::invalid_argument("precedence constraints contain a cycle");
+		return order;
+	}
+
+	// ДП по дереву зависимостей, когда у каждого места не больше одного
+	// обязательного предшественника: места обходятся в прямом порядке
+	// обхода леса, f[k][w] = max(f[конец поддерева k][w], f[k + 1][w - w_k] + v_k),
+	// то есть место либо берется вместе с продолжением обхода, либо
+	// пропускается со всем поддеревом. O(nW)
+	std::vector<size_t> SolveTreeKnapsack(const std::vector<int>& weights, const std::vector<int>& values,
+		const std::vector<std::vector<size_t>>& children, const std::vector<char>& isRoot, int capacity)
+	{
+		const size_t n = weights.size();
+		const size_t width = static_cast<size_t>(capacity) + 1;
+
+		// прямой порядок обхода и конец поддерева каждой позиции
+		std::vector<size_t> preorder, subtreeEnd(n);
+		preorder.reserve(n);
+		std::vector<std::pair<size_t, size_t>> stack;
+		for (size_t root = 0; root < n; ++root)
+		{
+			if (!isRoot[root]) continue;
+			stack.emplace_back(root, 0);
+			preorder.push_back(root);
+			while (!stack.empty())
+			{
+				auto& [node, child] = stack.back();
+				if (child < children[node].size())
+				{
+					const size_t next = children[node][child++];
+					preorder.push_back(next);
+					stack.emplace_back(next, 0);
+				}
+				else
+				{
+					subtreeEnd[node] = preorder.size();
+					stack.pop_back();
+				}
+			}
+		}
+
+		std::vector<int> f((n + 1) * width, 0);
+		std::vector<uint64_t> keep((n * width + 63) / 64, 0);
+		for (size_t k = n; k-- > 0;)
+		{
+			const size_t i = preorder[k];
+			const size_t wi = static_cast<size_t>(weights[i]);
+			const int* skip = &f[subtreeEnd[i] * width];
+			const int* go = &f[(k + 1) * width];
+			int* dst = &f[k * width];
+			for (size_t w = 0; w < width; ++w)
+			{
+				dst[w] = skip[w];
+				if (w >= wi && go[w - wi] + values[i] > dst[w])
+				{
+					dst[w] = go[w - wi] + values[i];
+					keep[(k * width + w) / 64] |= uint64_t(1) << ((k * width + w) % 64);
+				}
+			}
+		}
+
+		std::vector<size_t> res;
+		for (size_t k = 0, w = width - 1; k < n;)
+		{
+			const size_t i = preorder[k];
+			if (keep[(k * width + w) / 64] >> ((k * width + w) % 64) & 1)
+			{
+				res.push_back(i);
+				w -= static_cast<size_t>(weights[i]);
+				++k;
+			}
+			else k = subtreeEnd[i];
+		}
+		return res;
+	}
+
+	// ветви и границы для произвольных зависимостей в порядке важности
+	// в час: взятие места берет и всех его еще не решенных предшественников,
+	// отказ от места отказывается и от всех зависящих от него. Граница -
+	// дробный рюкзак по нерешенным местам
+	std::vector<size_t> SolvePrecedenceBranchAndBound(const std::vector<int>& weights, const std::vector<int>& values,
+		const std::vector<std::vector<size_t>>& required, const std::vector<std::vector<size_t>>& dependent, int capacity)
+	{
+		const size_t n = weights.size();
+		std::vector<size_t> ratio(n);
+		std::iota(ratio.begin(), ratio.end(), size_t(0));
+		std::stable_sort(ratio.begin(), ratio.end(), [&](size_t a, size_t b)
+			{
+				return int64_t(values[a]) * weights[b] > int64_t(values[b]) * weights[a];
+			});
+
+		enum : char { UNDECIDED, TAKEN, REJECTED };
+		std::vector<char> state(n, UNDECIDED), best(n, UNDECIDED);
+		int bestValue = -1;
+		// измененные места для отката
+		std::vector<size_t> trail, stack;
+		auto undo = [&](size_t mark)
+		{
+			for (; trail.size() > mark; trail.pop_back()) state[trail.back()] = UNDECIDED;
+		};
+
+		// false, если место с предшественниками не помещается
+		auto take = [&](size_t i, int& cap, int& value)
+		{
+			stack.assign(1, i);
+			while (!stack.empty())
+			{
+				const size_t j = stack.back();
+				stack.pop_back();
+				if (state[j] == TAKEN) continue;
+				if (state[j] == REJECTED || weights[j] > cap) return false;
+				state[j] = TAKEN;
+				trail.push_back(j);
+				cap -= weights[j];
+				value += values[j];
+				for (size_t p : required[j]) stack.push_back(p);
+			}
+			return true;
+		};
+		auto reject = [&](size_t i)
+		{
+			stack.assign(1, i);
+			while (!stack.empty())
+			{
+				const size_t j = stack.back();
+				stack.pop_back();
+				if (state[j] != UNDECIDED) continue;
+				state[j] = REJECTED;
+				trail.push_back(j);
+				for (size_t d : dependent[j]) stack.push_back(d);
+			}
+		};
+		auto bound = [&](size_t k, int cap, int value)
+		{
+			double res = value;
+			for (; k < n; ++k)
+			{
+				const size_t i = ratio[k];
+				if (state[i] != UNDECIDED) continue;
+				if (weights[i] <= cap)
+				{
+					cap -= weights[i];
+					res += values[i];
+				}
+				else
+				{
+					res += double(values[i]) * cap / weights[i];
+					break;
+				}
+			}
+			return res;
+		};
+
+		auto search = [&](auto& self, size_t k, int cap, int value) -> void
+		{
+			while (k < n && state[ratio[k]] != UNDECIDED) ++k;
+			if (value > bestValue)
+			{
+				bestValue = value;
+				best = state;
+			}
+			if (k == n || std::floor(bound(k, cap, value) + 1e-9) <= bestValue) return;
+
+			const size_t i = ratio[k];
+			const size_t mark = trail.size();
+			int takenCap = cap, takenValue = value;
+			if (take(i, takenCap, takenValue)) self(self, k + 1, takenCap, takenValue);
+			undo(mark);
+			reject(i);
+			self(self, k + 1, cap, value);
+			undo(mark);
+		};
+		search(search, 0, capacity, 0);
+
+		std::vector<size_t> res;
+		for (size_t i = 0; i < n; ++i)
+			if (best[i] == TAKEN) res.push_back(i);
+		return res;
+	}
+
+	// оптимум по важности с учетом предшествования. Места маршрута идут
+	// в допустимом порядке. Лес обязательных зависимостей решается ДП по
+	// дереву, остальные случаи - методом ветвей и границ
+	Route SolveWithPrecedence(const std::vector<Precedence>& rules, const std::vector<Place>& catalog = places,
+		float time = VISIT_TIME - SLEEP_TIME)
+	{
+		const size_t n = catalog.size();
+		const std::vector<size_t> topo = TopologicalOrder(n, rules);
+		const int capacity = BudgetUnits(time);
+		if (capacity < 0) return {};
+
+		std::vector<int> weights(n), values(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			weights[i] = ToUnits(catalog[i].time);
+			values[i] = catalog[i].value;
+		}
+		std::vector<std::vector<size_t>> required(n), children(n);
+		for (const auto& r : rules)
+		{
+			if (!r.required) continue;
+			required[r.after].push_back(r.before);
+			children[r.before].push_back(r.after);
+		}
+		for (auto& r : required)
+		{
+			std::sort(r.begin(), r.end());
+			r.erase(std::unique(r.begin(), r.end()), r.end());
+		}
+
+		std::vector<size_t> chosen;
+		if (std::all_of(required.begin(), required.end(), [](const auto& r) { return r.size() <= 1; }))
+		{
+			std::vector<char> isRoot(n);
+			for (size_t i = 0; i < n; ++i) isRoot[i] = required[i].empty();
+			for (auto& c : children)
+			{
+				std::sort(c.begin(), c.end());
+				c.erase(std::unique(c.begin(), c.end()), c.end());
+			}
+			chosen = SolveTreeKnapsack(weights, values, children, isRoot, capacity);
+		}
+		else chosen = SolvePrecedenceBranchAndBound(weights, values, required, children, capacity);
+
+		std::vector<char> selected(n, 0);
+		for (size_t i : chosen) selected[i] = 1;
+		Route route;
+		for (size_t i : topo)
+			if (selected[i]) route.places.push_back(catalog[i]);
+		return route;
+	}
+
+	// -------------
+	// часы работы и расписание
+	// -------------
+
+	// интервал в часах от начала поездки
+	struct TimeWindow
+	{
+		float	open;
+		float	close;
+	};
+
+	// поездка начинается в 7:00, сон с 23:00 до 7:00
+	constexpr float TRIP_START_HOUR = 7.0f;
+
+	// окна для места, открытого каждый день с openHour до closeHour:
+	// посещение должно начаться не позже, чем за duration до закрытия
+	std::vector<TimeWindow> DailyWindows(float openHour, float closeHour, float duration, float horizon = VISIT_TIME)
+	{
+		std::vector<TimeWindow> res;
+		for (float day = -24; day < horizon; day += 24)
+		{
+			const float open = std::max(day + openHour - TRIP_START_HOUR, 0.0f);
+			const float close = std::min(day + closeHour - TRIP_START_HOUR - duration, horizon - duration);
+			if (open <= close) res.push_back({ open, close });
+		}
+		return res;
+	}
+
+	std::vector<TimeWindow> NightlySleep(float horizon = VISIT_TIME)
+	{
+		std::vector<TimeWindow> res;
+		for (float day = 0; day < horizon; day += 24)
+			res.push_back({ day + 23 - TRIP_START_HOUR, std::min(day + 31 - TRIP_START_HOUR, horizon) });
+		return res;
+	}
+
+	// окна, в которые может начаться посещение каждого места (пусто - в любое
+	// время), и интервалы, на которые посещения не могут приходиться
+	struct Timetable
+	{
+		std::vector<std::vector<TimeWindow>>	windows;
+		std::vector<TimeWindow>					blocked = NightlySleep();
+		float									horizon = VISIT_TIME;
+	};
+
+	// маршрут с временем начала каждого посещения, starts[k] - для
+	// route.places[k]. exact - оптимальность доказана, false, если метки
+	// отбрасывались из-за ограничения ширины
+	struct Schedule
+	{
+		Route				route;
+		std::vector<float>	starts;
+		bool				exact = true;
+	};
+
+	// выбор и порядок посещений с учетом часов работы: ДП по меткам
+	// (время, посещенные места), метки расширяются по одному посещению.
+	// Из меток с одинаковым набором мест остается самая ранняя, метка
+	// отбрасывается, если другая не позже, не менее важна и ее посещенные
+	// вместе с уже недостижимыми местами - подмножество ее набора.
+	// На каждом шаге остается не больше beamWidth лучших по важности меток
+	Schedule ScheduleVisits(const Timetable& table, const std::vector<Place>& catalog = places, size_t beamWidth = 512)
+	{
+		const size_t n = catalog.size();
+		if (!table.windows.empty() && table.windows.size() != n) throw std::invalid_argument("timetable does not match the catalog");
+		const size_t words = (n + 63) / 64;
+
+		// самое раннее допустимое начало места i не раньше t, -1 если нет
+		auto earliest = [&](size_t i, float t)
+		{
+			const float d = catalog[i].time;
+			auto tryWindow = [&](float open, float close)
+			{
+				float s = std::max(t, open);
+				for (bool moved = true; moved && s <= close;)
+				{
+					moved = false;
+					for (const auto& b : table.blocked)
+					{
+						if (s < b.close && s + d > b.open)
+						{
+							s = b.close;
+							moved = true;
+						}
+					}
+				}
+				return (s <= close && s + d <= table.horizon) ? s : -1.0f;
+			};
+			if (table.windows.empty() || table.windows[i].empty()) return tryWindow(0, table.horizon);
+			for (const auto& w : table.windows[i])
+			{
+				if (w.close < t) continue;
+				if (const float s = tryWindow(w.open, w.close); s >= 0) return s;
+			}
+			return -1.0f;
+		};
+
+		// места в порядке последнего возможного начала: недостижимые
+		// к моменту t места - префикс этого порядка
+		std::vector<float> lastStart(n, -1.0f);
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (table.windows.empty() || table.windows[i].empty()) lastStart[i] = table.horizon - catalog[i].time;
+			else for (const auto& w : table.windows[i]) lastStart[i] = std::max(lastStart[i], std::min(w.close, table.horizon - catalog[i].time));
+		}
+		std::vector<size_t> byLastStart(n);
+		std::iota(byLastStart.begin(), byLastStart.end(), size_t(0));
+		std::sort(byLastStart.begin(), byLastStart.end(), [&](size_t a, size_t b) { return lastStart[a] < lastStart[b]; });
+
+		struct Label
+		{
+			float		time;
+			int			value;
+			uint32_t	parent;
+			uint32_t	place;
+			float		start;
+		};
+		// все метки и их наборы посещенных мест подряд по words слов
+		std::vector<Label> labels{ { 0, 0, ~0u, ~0u, 0 } };
+		std::vector<uint64_t> sets(words, 0);
+		auto set = [&](size_t label) { return sets.data() + label * words; };
+
+		Schedule res;
+		size_t best = 0;
+		std::vector<size_t> level{ 0 };
+
+		// расширения уровня: метки и их наборы мест подряд
+		std::vector<Label> next;
+		std::vector<uint64_t> nextSets;
+		auto nextSet = [&](size_t c) { return nextSets.data() + c * words; };
+		auto hashSet = [words](const uint64_t* s)
+		{
+			uint64_t h = 0;
+			for (size_t w = 0; w < words; ++w) h = (h ^ s[w]) * 0x9e3779b97f4a7c15ull;
+			return static_cast<size_t>(h ^ (h >> 29));
+		};
+		std::vector<uint32_t> order;
+		std::vector<uint64_t> reach(words), keptReach;
+		while (!level.empty())
+		{
+			next.clear();
+			nextSets.clear();
+			for (size_t l : level)
+			{
+				const Label from = labels[l];
+				for (size_t i = 0; i < n; ++i)
+				{
+					if (set(l)[i / 64] >> (i % 64) & 1 || lastStart[i] < from.time) continue;
+					const float s = earliest(i, from.time);
+					if (s < 0) continue;
+					next.push_back({ s + catalog[i].time, from.value + catalog[i].value, static_cast<uint32_t>(l), static_cast<uint32_t>(i), s });
+					nextSets.insert(nextSets.end(), set(l), set(l) + words);
+					nextSet(next.size() - 1)[i / 64] |= uint64_t(1) << (i % 64);
+				}
+			}
+
+			// по убыванию важности, затем по времени: первая метка с данным
+			// набором мест - самая ранняя из них
+			order.resize(next.size());
+			std::iota(order.begin(), order.end(), 0u);
+			std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+				{
+					return next[a].value != next[b].value ? next[a].value > next[b].value : next[a].time < next[b].time;
+				});
+			auto sameSet = [&](uint32_t a, uint32_t b) { return std::equal(nextSet(a), nextSet(a) + words, nextSet(b)); };
+			std::unordered_multimap<size_t, uint32_t> seen;
+
+			// отсев доминируемых меток
+			std::vector<size_t> kept;
+			keptReach.clear();
+			level.clear();
+			for (uint32_t c : order)
+			{
+				const Label& l = next[c];
+				const size_t h = hashSet(nextSet(c));
+				const auto [first, last] = seen.equal_range(h);
+				if (std::any_of(first, last, [&](const auto& o) { return sameSet(o.second, c); })) continue;
+				seen.emplace(h, c);
+				if (kept.size() == beamWidth)
+				{
+					res.exact = false;
+					break;
+				}
+
+				std::copy(nextSet(c), nextSet(c) + words, reach.begin());
+				for (size_t i : byLastStart)
+				{
+					if (lastStart[i] >= l.time) break;
+					reach[i / 64] |= uint64_t(1) << (i % 64);
+				}
+				bool dominated = false;
+				for (size_t j = 0; j < kept.size() && !dominated; ++j)
+				{
+					if (labels[kept[j]].time > l.time) continue;
+					const uint64_t* other = keptReach.data() + j * words;
+					dominated = true;
+					for (size_t w = 0; w < words && dominated; ++w) dominated = (other[w] & ~reach[w]) == 0;
+				}
+				if (dominated) continue;
+
+				kept.push_back(labels.size());
+				keptReach.insert(keptReach.end(), reach.begin(), reach.end());
+				labels.push_back(l);
+				sets.insert(sets.end(), nextSet(c), nextSet(c) + words);
+				level.push_back(labels.size() - 1);
+				if (l.value > labels[best].value || (l.value == labels[best].value && l.time < labels[best].time)) best = labels.size() - 1;
+			}
+		}
+
+		for (size_t l = best; labels[l].parent != ~0u; l = labels[l].parent)
+		{
+			res.route.places.push_back(catalog[labels[l].place]);
+			res.starts.push_back(labels[l].start);
+		}
+		std::reverse(res.route.places.begin(), res.route.places.end());
+		std::reverse(res.starts.begin(), res.starts.end());
+		return res;
+	}
+
+	// -------------
+	// важность в зависимости от времени посещения
+	// -------------
+
+	// множитель важности места по часу суток начала посещения
+	struct ValueProfile
+	{
+		std::array<float, 24>	factor;
+	};
+
+	constexpr ValueProfile FLAT_PROFILE = { { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 } };
+
+	// важность каждого места для каждого интервала начала длиной TIME_STEP,
+	// таблица по интервалам: values[b * n + i]. Профили транспонируются
+	// в строки по часам, и внутренний цикл по местам идет по непрерывным
+	// массивам без ветвлений, поэтому векторизуется компилятором.
+	// profiles пуст - важность не зависит от времени
+	std::vector<int> EvaluateProfiles(const std::vector<ValueProfile>& profiles, const std::vector<Place>& catalog, size_t buckets)
+	{
+		const size_t n = catalog.size();
+		if (!profiles.empty() && profiles.size() != n) throw std::invalid_argument("profiles do not match the catalog");
+
+		std::vector<float> base(n), byHour(24 * n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			base[i] = static_cast<float>(catalog[i].value);
+			for (size_t h = 0; h < 24; ++h) byHour[h * n + i] = profiles.empty() ? 1.0f : profiles[i].factor[h];
+		}
+
+		std::vector<int> values(buckets * n);
+		for (size_t b = 0; b < buckets; ++b)
+		{
+			const size_t hour = static_cast<size_t>(std::fmod(TRIP_START_HOUR + b * TIME_STEP, 24.0f));
+			const float* factor = byHour.data() + hour * n;
+			int* out = values.data() + b * n;
+			for (size_t i = 0; i < n; ++i) out[i] = static_cast<int>(base[i] * factor[i] + 0.5f);
+		}
+		return values;
+	}
+
+	// лучшее расписание при важности, зависящей от времени начала. Ось
+	// времени - часы от начала поездки с шагом TIME_STEP, интервалы сна
+	// и окна места из table учитываются, поэтому бюджет задается часами,
+	// а не числом VISIT_TIME - SLEEP_TIME. ДП по концу последнего
+	// посещения f[t] = max(f[t - 1], f[t - d_i] + v_i(t - d_i) - mu_i) не
+	// следит за повторами мест, поэтому повторы штрафуются множителями
+	// Лагранжа mu_i, подбираемыми субградиентным методом. Из каждого решения
+	// повторы удаляются, а освободившееся время заполняется неиспользованными
+	// местами. Начальное решение - расписание ScheduleVisits, оцененное по
+	// профилям. exact - найденная важность совпала с верхней границей
+	Schedule PlanTimeDependent(const std::vector<ValueProfile>& profiles, const Timetable& table = {},
+		const std::vector<Place>& catalog = places, int iterations = 200)
+	{
+		const size_t n = catalog.size();
+		if (!table.windows.empty() && table.windows.size() != n) throw std::invalid_argument("timetable does not match the catalog");
+		const size_t buckets = static_cast<size_t>(std::max(BudgetUnits(table.horizon), 0));
+		std::vector<int> values = EvaluateProfiles(profiles, catalog, buckets);
+
+		// посещение не может начаться вне окон, заходить на сон и за горизонт
+		constexpr int NOT_ALLOWED = -(1 << 29);
+		std::vector<int> length(n);
+		std::vector<char> awake(buckets, 1);
+		for (const auto& b : table.blocked)
+			for (size_t s = 0; s < buckets; ++s)
+				if (s * TIME_STEP < b.close && (s + 1) * TIME_STEP > b.open) awake[s] = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			length[i] = ToUnits(catalog[i].time);
+			for (size_t s = 0; s < buckets; ++s)
+			{
+				bool ok = s + length[i] <= buckets && std::all_of(awake.begin() + s, awake.begin() + s + std::min<size_t>(length[i], buckets - s), [](char a) { return a != 0; });
+				if (ok && !table.windows.empty() && !table.windows[i].empty())
+				{
+					const float start = s * TIME_STEP;
+					ok = std::any_of(table.windows[i].begin(), table.windows[i].end(), [&](const TimeWindow& w) { return w.open <= start + 1e-4f && start <= w.close + 1e-4f; });
+				}
+				if (!ok) values[s * n + i] = NOT_ALLOWED;
+			}
+		}
+		auto value = [&](size_t i, size_t s) { return values[s * n + i]; };
+
+		// занятость интервалов и дозаполнение свободного времени
+		auto fill = [&](std::vector<std::pair<size_t, size_t>>& visits)
+		{
+			std::vector<char> busy(buckets, 0), used(n, 0);
+			for (const auto& [i, s] : visits)
+			{
+				used[i] = 1;
+				std::fill(busy.begin() + s, busy.begin() + s + length[i], 1);
+			}
+			std::vector<size_t> order(n);
+			std::iota(order.begin(), order.end(), size_t(0));
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return catalog[a].value > catalog[b].value; });
+			for (size_t i : order)
+			{
+				if (used[i]) continue;
+				size_t bestStart = buckets;
+				for (size_t s = 0; s + length[i] <= buckets; ++s)
+				{
+					if (value(i, s) <= 0 || std::any_of(busy.begin() + s, busy.begin() + s + length[i], [](char b) { return b != 0; })) continue;
+					if (bestStart == buckets || value(i, s) > value(i, bestStart)) bestStart = s;
+				}
+				if (bestStart == buckets) continue;
+				std::fill(busy.begin() + bestStart, busy.begin() + bestStart + length[i], 1);
+				visits.emplace_back(i, bestStart);
+			}
+		};
+
+		std::vector<double> mu(n, 0.0), f(buckets + 1);
+		std::vector<int> choice(buckets + 1);
+		std::vector<int> count(n);
+		std::vector<std::pair<size_t, size_t>> visits, best;
+		int bestValue = 0;
+
+		// начальное решение - расписание ДП по меткам без учета профилей,
+		// начала округляются вверх до интервала, поэтому при важности,
+		// не зависящей от времени, результат не хуже ScheduleVisits
+		{
+			const Schedule labeled = ScheduleVisits(table, catalog);
+			std::unordered_multimap<std::string, size_t> index;
+			for (size_t i = 0; i < n; ++i) index.emplace(catalog[i].name, i);
+			std::vector<char> taken(n, 0);
+			size_t cursor = 0;
+			for (size_t k = 0; k < labeled.route.places.size(); ++k)
+			{
+				const Place& p = labeled.route.places[k];
+				const auto [first, last] = index.equal_range(p.name);
+				const auto it = std::find_if(first, last, [&](const auto& e) { return !taken[e.second] && catalog[e.second].time == p.time && catalog[e.second].value == p.value; });
+				if (it == last) continue;
+				const size_t i = it->second;
+				size_t s = std::max(cursor, static_cast<size_t>(std::max(ToUnits(labeled.starts[k]), 0)));
+				while (s + length[i] <= buckets && value(i, s) == NOT_ALLOWED) ++s;
+				if (s + length[i] > buckets) continue;
+				taken[i] = 1;
+				best.emplace_back(i, s);
+				cursor = s + length[i];
+			}
+			fill(best);
+			for (const auto& [i, s] : best) bestValue += value(i, s);
+		}
+		double upper = std::numeric_limits<double>::infinity(), theta = 2;
+		int stall = 0;
+
+		for (int it = 0; it < iterations; ++it)
+		{
+			f[0] = 0;
+			for (size_t t = 1; t <= buckets; ++t)
+			{
+				f[t] = f[t - 1];
+				choice[t] = -1;
+				for (size_t i = 0; i < n; ++i)
+				{
+					if (static_cast<size_t>(length[i]) > t) continue;
+					const size_t s = t - length[i];
+					if (value(i, s) == NOT_ALLOWED) continue;
+					if (const double c = f[s] + value(i, s) - mu[i]; c > f[t])
+					{
+						f[t] = c;
+						choice[t] = static_cast<int>(i);
+					}
+				}
+			}
+
+			// восстановление и удаление повторов: остается самое важное посещение места
+			visits.clear();
+			std::fill(count.begin(), count.end(), 0);
+			for (size_t t = buckets; t > 0;)
+			{
+				if (choice[t] < 0) { --t; continue; }
+				const size_t i = static_cast<size_t>(choice[t]);
+				t -= length[i];
+				++count[i];
+				visits.emplace_back(i, t);
+			}
+			const double bound = f[buckets] + std::accumulate(mu.begin(), mu.end(), 0.0);
+			if (bound < upper - 1e-9) stall = 0;
+			else if (++stall % 10 == 0) theta /= 2;
+			upper = std::min(upper, bound);
+
+			std::stable_sort(visits.begin(), visits.end(), [&](const auto& a, const auto& b) { return value(a.first, a.second) > value(b.first, b.second); });
+			std::vector<char> seen(n, 0);
+			std::erase_if(visits, [&](const auto& v) { return std::exchange(seen[v.first], 1) != 0; });
+			fill(visits);
+
+			int total = 0;
+			for (const auto& [i, s] : visits) total += value(i, s);
+			if (total > bestValue || best.empty())
+			{
+				bestValue = total;
+				best = visits;
+			}
+
+			double norm = 0;
+			for (size_t i = 0; i < n; ++i)
+				if (count[i] > 1 || mu[i] > 0) norm += double(1 - count[i]) * (1 - count[i]);
+			if (norm == 0 || bestValue >= std::floor(upper + 1e-9)) break;
+			const double step = theta * (upper - bestValue) / norm;
+			for (size_t i = 0; i < n; ++i) mu[i] = std::max(0.0, mu[i] - step * (1 - count[i]));
+		}
+
+		std::sort(best.begin(), best.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+		Schedule res;
+		res.exact = bestValue >= std::floor(upper + 1e-9);
+		for (const auto& [i, s] : best)
+		{
+			Place p = catalog[i];
+			p.value = value(i, s);
+			res.route.places.push_back(std::move(p));
+			res.starts.push_back(s * TIME_STEP);
+		}
+		return res;
+	}
+
+	// -------------
+	// случайная длительность посещений
+	// -------------
+
+	// коэффициент вариации длительности по умолчанию
+	constexpr float DEFAULT_DURATION_CV = 0.2f;
+
+	// оценка маршрута по сценариям: вероятность не уложиться во время,
+	// средняя важность мест, которые успели посетить до конца времени,
+	// и среднее время маршрута
+	struct RouteRisk
+	{
+		double	overrunProbability;
+		double	expectedValue;
+		double	expectedTime;
+	};
+
+	// оценка маршрутов методом Монте-Карло. Длительность места -
+	// логнормальная величина со средним Place::time и коэффициентом вариации
+	// cv[i]. Длительности всех мест для scenarios сценариев разыгрываются
+	// один раз (n * scenarios чисел), так что все маршруты сравниваются на
+	// одних и тех же сценариях. Циклы по сценариям идут по непрерывным
+	// массивам без ветвлений и векторизуются компилятором
+	class MonteCarloEvaluator
+	{
+	public:
+		explicit MonteCarloEvaluator(const std::vector<Place>& catalog = places, std::vector<float> cv = {}, size_t scenarios = 4096,
+			uint64_t seed = 1, ThreadPool* pool = nullptr)
+			: catalog(catalog), scenarios(std::max<size_t>(scenarios, 1)), samples(catalog.size() * this->scenarios)
+		{
+			if (cv.empty()) cv.assign(catalog.size(), DEFAULT_DURATION_CV);
+			if (cv.size() != catalog.size()) throw std::invalid_argument("duration spread does not match the catalog");
+			index.reserve(catalog.size());
+			for (size_t i = 0; i < catalog.size(); ++i) index.emplace(catalog[i].name, i);
+			ParallelFor(catalog.size(), pool, [&](size_t i) { Sample(i, cv[i], seed); });
+		}
+
+		const std::vector<Place>& Catalog() const { return catalog; }
+		size_t Scenarios() const { return scenarios; }
+
+		// места маршрута посещаются по порядку, место, закончившееся
+		// после time, не приносит важности. Места сопоставляются с каталогом
+		// по названию, времени, важности и стоимости: строки с одним
+		// названием - разные варианты посещения (GroupByName)
+		RouteRisk Evaluate(const Route& r, float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			thread_local std::vector<size_t> selected;
+			selected.clear();
+			for (const auto& p : r.places) selected.push_back(IndexOf(p));
+			return Evaluate(std::span<const size_t>(selected), time);
+		}
+
+		// маршрут из мест каталога с индексами selected в этом порядке
+		RouteRisk Evaluate(std::span<const size_t> selected, float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			thread_local std::vector<float> elapsed, value;
+			elapsed.assign(scenarios, 0.0f);
+			value.assign(scenarios, 0.0f);
+			float* acc = elapsed.data();
+			float* got = value.data();
+			for (size_t i : selected)
+			{
+				if (i >= catalog.size()) throw std::out_of_range("place index out of range");
+				const float* d = samples.data() + i * scenarios;
+				const float v = static_cast<float>(catalog[i].value);
+				for (size_t s = 0; s < scenarios; ++s)
+				{
+					acc[s] += d[s];
+					got[s] += acc[s] <= time ? v : 0.0f;
+				}
+			}
+
+			size_t overruns = 0;
+			double totalValue = 0, totalTime = 0;
+			for (size_t s = 0; s < scenarios; ++s)
+			{
+				overruns += acc[s] > time;
+				totalValue += got[s];
+				totalTime += acc[s];
+			}
+			return { double(overruns) / scenarios, totalValue / scenarios, totalTime / scenarios };
+		}
+
+		std::vector<RouteRisk> Evaluate(std::span<const Route> routes, float time = VISIT_TIME - SLEEP_TIME, ThreadPool* pool = nullptr) const
+		{
+			std::vector<RouteRisk> res(routes.size());
+			ParallelFor(routes.size(), pool, [&](size_t i) { res[i] = Evaluate(routes[i], time); });
+			return res;
+		}
+
+		std::vector<RouteRisk> Evaluate(std::span<const std::vector<size_t>> selections, float time = VISIT_TIME - SLEEP_TIME,
+			ThreadPool* pool = nullptr) const
+		{
+			std::vector<RouteRisk> res(selections.size());
+			ParallelFor(selections.size(), pool, [&](size_t i) { res[i] = Evaluate(std::span<const size_t>(selections[i]), time); });
+			return res;
+		}
+
+	private:
+		size_t IndexOf(const Place& p) const
+		{
+			const auto [first, last] = index.equal_range(p.name);
+			for (auto it = first; it != last; ++it)
+			{
+				const Place& c = catalog[it->second];
+				if (c.time == p.time && c.value == p.value && c.cost == p.cost) return it->second;
+			}
+			throw std::invalid_argument(std::format("place '{}' is not in the catalog", p.name));
+		}
+
+		// f(0) .. f(count - 1) кусками на потоках пула или в вызывающем потоке
+		template<class F>
+		static void ParallelFor(size_t count, ThreadPool* pool, F&& f)
+		{
+			const size_t team = pool ? std::min<size_t>(pool->Size(), count) : 1;
+			if (team <= 1)
+			{
+				for (size_t i = 0; i < count; ++i) f(i);
+				return;
+			}
+			pool->ForEach(count, f);
+		}
+
+		// длительности места i во всех сценариях. Случайные числа берутся из
+		// счетчика (seed, место, сценарий), поэтому не зависят от числа потоков
+		void Sample(size_t i, float cv, uint64_t seed)
+		{
+			const float sigma2 = std::log1p(cv * cv);
+			const float sigma = std::sqrt(sigma2);
+			const float mu = std::log(catalog[i].time) - sigma2 / 2;
+
+			float* out = samples.data() + i * scenarios;
+			std::vector<float> u1(scenarios), u2(scenarios);
+			const uint64_t base = (seed ^ (uint64_t(i) * 0xd1b54a32d192ed03ull)) * 2 * scenarios;
+			auto mix = [](uint64_t x)
+			{
+				x += 0x9e3779b97f4a7c15ull;
+				x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+				x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+				return x ^ (x >> 31);
+			};
+			// 24 старших бита в (0, 1]
+			for (size_t s = 0; s < scenarios; ++s)
+			{
+				u1[s] = static_cast<float>((mix(base + 2 * s) >> 40) + 1) * (1.0f / 16777216.0f);
+				u2[s] = static_cast<float>(mix(base + 2 * s + 1) >> 40) * (1.0f / 16777216.0f);
+			}
+			// преобразование Бокса - Мюллера и переход к логнормальному
+			constexpr float TWO_PI = 6.2831853f;
+			for (size_t s = 0; s < scenarios; ++s)
+				out[s] = std::exp(mu + sigma * std::sqrt(-2.0f * std::log(u1[s])) * std::cos(TWO_PI * u2[s]));
+		}
+
+		std::vector<Place>								catalog;
+		size_t											scenarios;
+		std::unordered_multimap<std::string, size_t>	index;
+		// длительности по местам: samples[i * scenarios + s]
+		std::vector<float>								samples;
+	};
+
+	// планирование с ограничением на риск: самый важный маршрут, который
+	// не укладывается во время с вероятностью не больше alpha. Кандидаты -
+	// точные оптимумы для всех меньших бюджетов из одной таблицы ДП,
+	// они оцениваются на сценариях одним пакетом
+	Route PlanChanceConstrained(const MonteCarloEvaluator& evaluator, float alpha = 0.05f, float time = VISIT_TIME - SLEEP_TIME,
+		ThreadPool* pool = nullptr)
+	{
+		const auto& catalog = evaluator.Catalog();
+		std::vector<int> weights, values;
+		for (const auto& p : catalog)
+		{
+			weights.push_back(ToUnits(p.time));
+			values.push_back(p.value);
+		}
+		const auto table = KnapsackTable::Build(weights, values, BudgetUnits(time), pool);
+
+		// кандидаты оцениваются по индексам каталога, а не по названиям
+		std::vector<std::vector<size_t>> candidates;
+		std::vector<int> candidateValues;
+		for (int c = table->Capacity(); c >= 0; --c)
+		{
+			std::vector<size_t> selected = table->Select(c);
+			if (!candidates.empty() && selected == candidates.back()) continue;
+			int value = 0;
+			for (size_t i : selected) value += catalog[i].value;
+			candidates.push_back(std::move(selected));
+			candidateValues.push_back(value);
+		}
+
+		const auto risks = evaluator.Evaluate(std::span<const std::vector<size_t>>(candidates), time, pool);
+		size_t best = candidates.size();
+		for (size_t k = 0; k < candidates.size(); ++k)
+		{
+			if (risks[k].overrunProbability > alpha) continue;
+			if (best == candidates.size() || candidateValues[k] > candidateValues[best]) best = k;
+		}
+		Route res;
+		if (best < candidates.size())
+			for (size_t i : candidates[best]) res.places.push_back(catalog[i]);
+		return res;
+	}
+
+	// -------------
+	// кэш результатов
+	// -------------
+
+	// ключ кэша: отпечаток каталога и параметры запроса
+	struct PlanKey
+	{
+		uint64_t	catalog;
+		float		time;
+		Strategy	strategy;
+
+		bool operator==(const PlanKey&) const = default;
+	};
+
+	struct PlanKeyHash
+	{
+		size_t operator()(const PlanKey& k) const
+		{
+			// -0 и +0 равны как ключи, поэтому должны давать один хэш
+			const float time = k.time == 0 ? 0.0f : k.time;
+			uint64_t h = k.catalog ^ (uint64_t(std::bit_cast<uint32_t>(time)) << 8) ^ uint64_t(k.strategy);
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdull;
+			h ^= h >> 33;
+			return static_cast<size_t>(h);
+		}
+	};
+
+	// ограниченный кэш маршрутов, разделенный на сегменты со своими
+	// блокировками. Вытеснение внутри сегмента - алгоритм CLOCK: при
+	// попадании запись помечается, стрелка пропускает помеченные записи,
+	// снимая пометку, и вытесняет первую непомеченную.
+	// одновременные промахи по одному ключу решаются независимо.
+	// ключ с nan не равен сам себе и не нашелся бы ни при поиске,
+	// ни при вытеснении, поэтому время в ключе должно быть конечным
+	class PlanCache
+	{
+	public:
+		struct Stats
+		{
+			uint64_t	hits;
+			uint64_t	misses;
+			uint64_t	evictions;
+			double		hitRate;
+			double		avgLookupUs;	// среднее время поиска в кэше
+			double		avgSolveUs;		// среднее время решения при промахе
+		};
+
+		explicit PlanCache(size_t capacity = size_t(1) << 16, size_t shardCount = 16)
+			: shards(std::max<size_t>(shardCount, 1))
+		{
+			perShard = std::max<size_t>(capacity / shards.size(), 1);
+		}
+
+		template<class Solve>
+		std::shared_ptr<const Route> GetOrSolve(const PlanKey& key, Solve&& solve)
+		{
+			using clock = std::chrono::steady_clock;
+			if (!std::isfinite(key.time)) throw std::invalid_argument("cache key time must be finite");
+			const size_t h = PlanKeyHash()(key);
+			Shard& s = shards[h % shards.size()];
+
+			const auto start = clock::now();
+			{
+				std::lock_guard lock(s.mtx);
+				if (auto it = s.index.find(key); it != s.index.end())
+				{
+					Slot& slot = s.slots[it->second];
+					slot.referenced = true;
+					auto route = slot.route;
+					hits.fetch_add(1, std::memory_order_relaxed);
+					lookupNs.fetch_add(Ns(clock::now() - start), std::memory_order_relaxed);
+					return route;
+				}
+			}
+			const auto lookedUp = clock::now();
+			lookupNs.fetch_add(Ns(lookedUp - start), std::memory_order_relaxed);
+			misses.fetch_add(1, std::memory_order_relaxed);
+
+			auto route = std::make_shared<const Route>(solve());
+			solveNs.fetch_add(Ns(clock::now() - lookedUp), std::memory_order_relaxed);
+
+			std::lock_guard lock(s.mtx);
+			if (s.index.contains(key)) return route;
+			if (s.slots.size() < perShard)
+			{
+				s.index.emplace(key, s.slots.size());
+				s.slots.push_back({ key, route, false });
+				return route;
+			}
+			while (s.slots[s.hand].referenced)
+			{
+				s.slots[s.hand].referenced = false;
+				s.hand = (s.hand + 1) % s.slots.size();
+			}
+			Slot& victim = s.slots[s.hand];
+			s.index.erase(victim.key);
+			victim = { key, route, false };
+			s.index.emplace(key, s.hand);
+			s.hand = (s.hand + 1) % s.slots.size();
+			evictions.fetch_add(1, std::memory_order_relaxed);
+			return route;
+		}
+
+		Stats GetStats() const
+		{
+			Stats st{ hits.load(), misses.load(), evictions.load(), 0, 0, 0 };
+			const uint64_t lookups = st.hits + st.misses;
+			if (lookups) st.hitRate = double(st.hits) / lookups;
+			if (lookups) st.avgLookupUs = lookupNs.load() / 1e3 / lookups;
+			if (st.misses) st.avgSolveUs = solveNs.load() / 1e3 / st.misses;
+			return st;
+		}
+
+	private:
+		static uint64_t Ns(std::chrono::steady_clock::duration d)
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+		}
+
+		struct Slot
+		{
+			PlanKey							key;
+			std::shared_ptr<const Route>	route;
+			bool							referenced;
+		};
+		struct Shard
+		{
+			std::mutex										mtx;
+			std::unordered_map<PlanKey, size_t, PlanKeyHash>	index;
+			std::vector<Slot>								slots;
+			size_t											hand = 0;
+		};
+
+		std::vector<Shard>		shards;
+		size_t					perShard;
+		std::atomic<uint64_t>	hits = 0, misses = 0, evictions = 0;
+		std::atomic<uint64_t>	lookupNs = 0, solveNs = 0;
+	};
+
+	// маршрут через кэш, fingerprint - отпечаток catalog.
+	// прерванное через stop решение не оптимально и в кэш не попадает
+	Route CachedPlan(PlanCache& cache, Strategy s, const std::vector<Place>& catalog, uint64_t fingerprint,
+		float time = VISIT_TIME - SLEEP_TIME, std::stop_token stop = {})
+	{
+		return *cache.GetOrSolve({ fingerprint, time, s }, [&]
+			{
+				Route r = Plan(s, catalog, time, stop);
+				if (stop.stop_requested()) throw std::runtime_error("query cancelled");
+				return r;
+			});
+	}
+
+	// запускает выбранные алгоритмы параллельно и возвращает лучший маршрут.
+	// как только точный алгоритм завершается или наступает крайний срок,
+	// остальные алгоритмы отменяются
+	Route RunPortfolio(std::span<const Strategy> strategies = ALL_STRATEGIES,
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+		const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		Incumbent best;
+		std::stop_source stop;
+		ThreadPool pool(static_cast<unsigned>(strategies.size()));
+
+		std::vector<std::future<void>> running;
+		for (Strategy s : strategies)
+		{
+			running.push_back(pool.Submit([&, s]
+				{
+					if (RunStrategy(s, catalog, time, best, stop.get_token())) stop.request_stop();
+				}));
+		}
+
+		for (auto& r : running)
+			if (r.wait_until(deadline) == std::future_status::timeout) stop.request_stop();
+		for (auto& r : running) r.get();
+
+		return best.Get();
+	}
+
+	// результат решения с ограничением по времени
+	struct AnytimeResult
+	{
+		Route	route;
+		int		upperBound;	// доказанная верхняя граница суммарной важности
+		float	gap;		// относительный разрыв между маршрутом и границей, 0 - оптимум
+	};
+
+	// решение с крайним сроком и внешней отменой. Начинает с ответа третьего
+	// алгоритма, улучшает его локальным поиском, затем методом ветвей и границ,
+	// и при остановке возвращает лучший найденный маршрут
+	AnytimeResult SolveAnytime(std::chrono::steady_clock::time_point deadline, std::stop_token cancel = {},
+		const std::vector<Place>& catalog = places, float time = VISIT_TIME - SLEEP_TIME, unsigned threads = 1)
+	{
+		std::vector<int> weights, values;
+		for (const auto& p : catalog)
+		{
+			weights.push_back(ToUnits(p.time));
+			values.push_back(p.value);
+		}
+		const int capacity = BudgetUnits(time);
+		auto toRoute = [&](const std::vector<size_t>& selected)
+		{
+			Route r;
+			for (size_t i : selected) r.places.push_back(catalog[i]);
+			return r;
+		};
+
+		// остановка по внешней отмене или по крайнему сроку
+		std::stop_source stop;
+		std::stop_callback onCancel(cancel, [&] { stop.request_stop(); });
+		std::jthread timer([&](std::stop_token st)
+			{
+				std::mutex mtx;
+				std::unique_lock lock(mtx);
+				std::condition_variable_any().wait_until(lock, st, deadline, [] { return false; });
+				stop.request_stop();
+			});
+
+		Incumbent best;
+		const std::vector<size_t> greedy = GreedyByHourValue(weights, values, capacity);
+		best.Offer(toRoute(greedy));
+		if (!stop.stop_requested())
+			best.Offer(toRoute(ImproveLocally(weights, values, capacity, greedy, stop.get_token())));
+
+		BranchAndBound bb(weights, values, capacity, false, stop.get_token(), &best.Value());
+		const int bound = static_cast<int>(std::floor(bb.UpperBound() + 1e-9));
+		bool proven = false;
+		if (!stop.stop_requested())
+		{
+			const auto selected = bb.Solve(threads);
+			if (!selected.empty()) best.Offer(toRoute(selected));
+			proven = bb.Complete();
+		}
+
+		AnytimeResult res{ best.Get(), bound, 0.0f };
+		const int value = res.route.TotalValue();
+		if (proven) res.upperBound = value;
+		else if (res.upperBound > 0) res.gap = float(res.upperBound - value) / res.upperBound;
+		return res;
+	}
+
+	// планирование прямо по отображенному каталогу: алгоритмы работают
+	// со столбцами файла, в маршрут копируются только выбранные места
+	Route PlanMapped(const MappedCatalog& catalog, Strategy s, float time = VISIT_TIME - SLEEP_TIME)
+	{
+		const auto times = catalog.Times();
+		const auto values = catalog.Values();
+		std::vector<size_t> selected;
+
+		if (s == Strategy::MostPlaces || s == Strategy::ByValue || s == Strategy::ByHourValue)
+		{
+			// тот же порядок, что и у генераторов первых трех алгоритмов
+			auto first = [&](size_t a, size_t b)
+			{
+				switch (s)
+				{
+				case Strategy::MostPlaces:	return times[a] < times[b];
+				case Strategy::ByValue:		return values[a] > values[b];
+				default:					return values[a] / times[a] > values[b] / times[b];
+				}
+			};
+			std::vector<size_t> order(catalog.Size());
+			std::iota(order.begin(), order.end(), size_t(0));
+			std::stable_sort(order.begin(), order.end(), first);
+
+			const GreedyTime budget = ToGreedyTime(time);
+			GreedyTime accTime = 0;
+			for (size_t i : order)
+			{
+				accTime += ToGreedyTime(times[i]);
+				if (accTime <= budget) selected.push_back(i);
+				else break;
+			}
+		}
+		else
+		{
+			std::vector<int> weights(times.size());
+			std::transform(times.begin(), times.end(), weights.begin(), ToUnits);
+			const int capacity = BudgetUnits(time);
+			switch (s)
+			{
+			case Strategy::LocalSearch:
+				selected = ImproveLocally(weights, values, capacity, GreedyByHourValue(weights, values, capacity));
+				break;
+			case Strategy::Optimal:
+				selected = *SolveKnapsackDP(weights, values, capacity);
+				break;
+			default:
+				selected = BranchAndBound(weights, values, capacity, false).Solve();
+				break;
+			}
+		}
+
+		Route res;
+		for (size_t i : selected) res.places.push_back(catalog.At(i));
+		return res;
+	}
+
+	// -------------
+	// пакетная обработка запросов
+	// -------------
+
+	// очередь ограниченного размера между стадиями конвейера.
+	// Push блокируется при заполнении, Pop - при опустошении.
+	// после Close Pop возвращает оставшиеся элементы, затем nullopt
+	template<class T>
+	class BoundedQueue
+	{
+	public:
+		explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+		void Push(T item)
+		{
+			std::unique_lock lock(mtx);
+			notFull.wait(lock, [this] { return items.size() < capacity; });
+			items.push_back(std::move(item));
+			notEmpty.notify_one();
+		}
+
+		std::optional<T> Pop()
+		{
+			std::unique_lock lock(mtx);
+			notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+			if (items.empty()) return std::nullopt;
+			T item = std::move(items.front());
+			items.pop_front();
+			notFull.notify_one();
+			return item;
+		}
+
+		void Close()
+		{
+			std::lock_guard lock(mtx);
+			closed = true;
+			notEmpty.notify_all();
+		}
+
+	private:
+		size_t					capacity;
+		std::mutex				mtx;
+		std::condition_variable	notFull, notEmpty;
+		std::deque<T>			items;
+		bool					closed = false;
+	};
+
+	std::optional<Strategy> ParseStrategy(std::string_view name)
+	{
+		for (Strategy s : ALL_STRATEGIES)
+			if (StrategyName(s) == name) return s;
+		return std::nullopt;
+	}
+
+	// запрос пакетного режима, одна строка входа:
+	// <время поездки> <время сна> <алгоритм> [<индекс места>=<время>:<важность> ...]
+	// например "48 16 VisitByHourValue 1=4:6". Переопределения меняют
+	// время и важность места каталога только для этого запроса
+	struct Query
+	{
+		size_t										line = 0;
+		float										visitTime = VISIT_TIME;
+		float										sleepTime = SLEEP_TIME;
+		Strategy									strategy = Strategy::ByHourValue;
+		std::vector<std::pair<size_t, Place>>		overrides;
+		Constraints									constraints;
+		std::string									error;
+	};
+
+	// наибольшее время в запросе, ч. Больше года поездки не бывает,
+	// а с запасом до переполнения шагов дискретизации в int
+	constexpr float MAX_QUERY_TIME = 24.0f * 366;
+
+	Query ParseQuery(std::string_view text, size_t line, const std::vector<Place>& catalog)
+	{
+		Query q;
+		q.line = line;
+		std::vector<std::string_view> tokens;
+		for (size_t pos = 0; pos < text.size();)
+		{
+			pos = text.find_first_not_of(" \t\r", pos);
+			if (pos == std::string_view::npos) break;
+			const size_t end = std::min(text.find_first_of(" \t\r", pos), text.size());
+			tokens.push_back(text.substr(pos, end - pos));
+			pos = end;
+		}
+
+		auto number = [](std::string_view s, auto& out)
+		{
+			const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+			return ec == std::errc() && ptr == s.data() + s.size();
+		};
+		// время конечно и не больше MAX_QUERY_TIME, nan и inf отсекаются сравнениями
+		auto time = [&](std::string_view s, float& out, float min)
+		{
+			return number(s, out) && out >= min && out <= MAX_QUERY_TIME;
+		};
+
+		if (tokens.size() < 3) q.error = "expected <visit time> <sleep time> <strategy>";
+		else if (!time(tokens[0], q.visitTime, 0) || !time(tokens[1], q.sleepTime, 0)) q.error = "invalid time";
+		else if (auto s = ParseStrategy(tokens[2])) q.strategy = *s;
+		else q.error = std::format("unknown strategy '{}'", tokens[2]);
+
+		for (size_t i = 3; i < tokens.size() && q.error.empty(); ++i)
+		{
+			// +<индекс> - обязательное место, -<индекс> - исключенное
+			if (tokens[i][0] == '+' || tokens[i][0] == '-')
+			{
+				size_t index = 0;
+				if (!number(tokens[i].substr(1), index)) q.error = std::format("invalid constraint '{}'", tokens[i]);
+				else if (index >= catalog.size()) q.error = std::format("place index {} out of range", index);
+				else (tokens[i][0] == '+' ? q.constraints.mandatory : q.constraints.forbidden).push_back(index);
+				continue;
+			}
+			const size_t eq = tokens[i].find('='), colon = tokens[i].find(':');
+			size_t index = 0;
+			Place p;
+			if (eq == std::string_view::npos || colon == std::string_view::npos || colon < eq
+				|| !number(tokens[i].substr(0, eq), index) || !time(tokens[i].substr(eq + 1, colon - eq - 1), p.time, 0)
+				|| !(p.time > 0) || !number(tokens[i].substr(colon + 1), p.value))
+				q.error = std::format("invalid override '{}'", tokens[i]);
+			else if (index >= catalog.size())
+				q.error = std::format("place index {} out of range", index);
+			else
+			{
+				p.name = catalog[index].name;
+				q.overrides.emplace_back(index, std::move(p));
+			}
+		}
+
+		if (q.error.empty() && !q.constraints.Empty())
+		{
+			std::vector<Place> changed = catalog;
+			for (const auto& [i, p] : q.overrides) changed[i] = p;
+			try
+			{
+				if (!Reduce(q.constraints, changed, q.visitTime - q.sleepTime))
+					q.error = "mandatory places exceed the time budget";
+			}
+			catch (const std::invalid_argument& e)
+			{
+				q.error = e.what();
+			}
+		}
+		return q;
+	}
+
+	// решение запроса по каталогу, переопределения применяются к его копии,
+	// ограничения сводят запрос к обычному по оставшимся местам.
+	// при наличии кэша fingerprint - отпечаток catalog.
+	// при отмене через stop выбрасывается исключение
+	Route SolveQuery(const Query& q, const std::vector<Place>& catalog, PlanCache* cache = nullptr, uint64_t fingerprint = 0,
+		std::stop_token stop = {})
+	{
+		auto plan = [&](const std::vector<Place>& c, uint64_t fp, float time)
+		{
+			if (cache) return CachedPlan(*cache, q.strategy, c, fp, time, stop);
+			Route r = Plan(q.strategy, c, time, stop);
+			if (stop.stop_requested()) throw std::runtime_error("query cancelled");
+			return r;
+		};
+
+		const float time = q.visitTime - q.sleepTime;
+		if (q.overrides.empty() && q.constraints.Empty()) return plan(catalog, fingerprint, time);
+
+		std::vector<Place> changed = catalog;
+		for (const auto& [i, p] : q.overrides) changed[i] = p;
+		if (q.constraints.Empty()) return plan(changed, cache ? CatalogFingerprint(changed) : 0, time);
+
+		auto problem = Reduce(q.constraints, changed, time);
+		if (!problem) throw std::invalid_argument("mandatory places exceed the time budget");
+		const Route rest = plan(problem->catalog, cache ? CatalogFingerprint(problem->catalog) : 0, problem->time);
+		return Complete(std::move(*problem), rest);
+	}
+
+	// решение запроса функцией solve и запись ответа в конец буфера.
+	// ошибка разбора или решения (в том числе нехватка памяти)
+	// записывается как ответ на эту строку
+	template<class Solve>
+	void AnswerQuery(const Query& q, Solve&& solve, bool json, std::string& out)
+	{
+		auto writeError = [&](std::string_view what)
+		{
+			if (json)
+			{
+				std::format_to(std::back_inserter(out), "{{\"line\":{},\"error\":", q.line);
+				AppendJsonString(out, what);
+				out.append("}\n");
+			}
+			else std::format_to(std::back_inserter(out), "error: line {}: {}\n\n", q.line, what);
+		};
+		if (!q.error.empty())
+		{
+			writeError(q.error);
+			return;
+		}
+
+		const size_t start = out.size();
+		try
+		{
+			const Route r = solve(q);
+			if (json)
+			{
+				AppendJson(out, r, StrategyName(q.strategy));
+				out.push_back('\n');
+			}
+			else
+			{
+				r.AppendTo(out);
+				out.append("\n\n");
+			}
+		}
+		catch (const std::exception& e)
+		{
+			out.resize(start);
+			writeError(e.what());
+		}
+	}
+
+	// пакетный режим: чтение и разбор, решение и вывод работают
+	// как отдельные стадии конвейера, связанные очередями ограниченного
+	// размера. Запросы передаются пачками, ответы выводятся в порядке входа
+	void RunBatch(std::istream& in, std::ostream& out, const std::vector<Place>& catalog = places,
+		unsigned threads = std::thread::hardware_concurrency(), bool json = false, PlanCache* cache = nullptr)
+	{
+		const uint64_t fingerprint = cache ? CatalogFingerprint(catalog) : 0;
+		constexpr size_t BATCH_SIZE = 256;
+		constexpr size_t READ_BLOCK = size_t(1) << 20;
+		threads = std::max(threads, 1u);
+
+		struct Batch
+		{
+			size_t				seq;
+			std::vector<Query>	queries;
+		};
+		struct Answer
+		{
+			size_t				seq;
+			std::string			text;
+		};
+		BoundedQueue<Batch> parsed(threads * 4);
+		BoundedQueue<Answer> answered(threads * 4);
+
+		// стадия вывода: восстанавливает порядок пачек
+		std::jthread emitter([&]
+			{
+				std::map<size_t, std::string> pending;
+				size_t next = 0;
+				while (auto a = answered.Pop())
+				{
+					pending.emplace(a->seq, std::move(a->text));
+					for (auto it = pending.find(next); it != pending.end(); it = pending.find(++next))
+					{
+						out.write(it->second.data(), static_cast<std::streamsize>(it->second.size()));
+						pending.erase(it);
+					}
+				}
+				out.flush();
+			});
+
+		// стадия решения. Пачка, опередившая вывод больше чем на размер
+		// окна, ждет, чтобы буфер восстановления порядка оставался ограниченным
+		std::mutex orderMtx;
+		std::condition_variable orderCv;
+		size_t oldestUnanswered = 0;
+		std::set<size_t> inFlight;
+		const size_t window = threads * 8;
+
+		ThreadPool pool(threads);
+		std::vector<std::future<void>> solvers;
+
+		// очереди закрываются на любом пути выхода, иначе стадии решения
+		// и вывода ждут вечно, а деструкторы пула и emitter не возвращаются
+		struct Shutdown
+		{
+			BoundedQueue<Batch>&			parsed;
+			std::vector<std::future<void>>&	solvers;
+			BoundedQueue<Answer>&			answered;
+
+			~Shutdown()
+			{
+				parsed.Close();
+				for (auto& s : solvers)
+					if (s.valid()) s.wait();
+				answered.Close();
+			}
+		} shutdown{ parsed, solvers, answered };
+
+		for (unsigned t = 0; t < threads; ++t)
+		{
+			solvers.push_back(pool.Submit([&]
+				{
+					while (auto b = parsed.Pop())
+					{
+						Answer a{ b->seq, {} };
+						for (const auto& q : b->queries)
+							AnswerQuery(q, [&](const Query& q) { return SolveQuery(q, catalog, cache, fingerprint); }, json, a.text);
+						{
+							std::unique_lock lock(orderMtx);
+							orderCv.wait(lock, [&] { return a.seq < oldestUnanswered + window; });
+						}
+						answered.Push(std::move(a));
+						{
+							std::lock_guard lock(orderMtx);
+							inFlight.erase(b->seq);
+							oldestUnanswered = inFlight.empty() ? b->seq + 1 : *inFlight.begin();
+						}
+						orderCv.notify_all();
+					}
+				}));
+		}
+
+		// стадия чтения и разбора: вход читается большими блоками
+		std::string buf(READ_BLOCK, '\0');
+		std::string tail;
+		Batch batch{ 0, {} };
+		size_t line = 0;
+		auto submit = [&]
+		{
+			{
+				std::lock_guard lock(orderMtx);
+				inFlight.insert(batch.seq);
+			}
+			const size_t seq = batch.seq;
+			parsed.Push(std::move(batch));
+			batch = Batch{ seq + 1, {} };
+		};
+		auto parseLine = [&](std::string_view text)
+		{
+			++line;
+			if (text.find_first_not_of(" \t\r") == std::string_view::npos) return;
+			batch.queries.push_back(ParseQuery(text, line, catalog));
+			if (batch.queries.size() == BATCH_SIZE) submit();
+		};
+		while (in)
+		{
+			in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+			std::string_view chunk(buf.data(), static_cast<size_t>(in.gcount()));
+			for (size_t eol; (eol = chunk.find('\n')) != std::string_view::npos; chunk.remove_prefix(eol + 1))
+			{
+				if (tail.empty()) parseLine(chunk.substr(0, eol));
+				else
+				{
+					tail.append(chunk.substr(0, eol));
+					parseLine(tail);
+					tail.clear();
+				}
+			}
+			tail.append(chunk);
+		}
+		if (!tail.empty()) parseLine(tail);
+		if (!batch.queries.empty()) submit();
+
+		parsed.Close();
+		for (auto& s : solvers) s.get();
+	}
+
+	// -------------
+	// инкрементальное точное решение
+	// -------------
+
+	// точный оптимум для изменяемого набора мест без полного пересчета.
+	// места хранятся в двух стеках строк ДП ("очередь из рюкзаков"):
+	// добавление кладет строку в задний стек за O(W), удаление самого
+	// старого места снимает строку с переднего стека, перекладывая задний
+	// в передний, когда тот пуст, - O(W) в среднем. Удаление из середины
+	// пересчитывает строки над удаляемой, в среднем половину всех, их число
+	// копится в RecomputedRows. Если удаления идут не по порядку добавления
+	// и последовательность изменений известна заранее, нужен KnapsackTimeline.
+	// Ответ - слияние верхних строк двух стеков за O(W)
+	class IncrementalKnapsack
+	{
+	public:
+		explicit IncrementalKnapsack(float maxTime = VISIT_TIME - SLEEP_TIME) : capacity(std::max(BudgetUnits(maxTime), 0)) {}
+
+		size_t Size() const { return front.size() + back.size(); }
+
+		// строки ДП, пересчитанные удалениями не по порядку добавления
+		size_t RecomputedRows() const { return recomputed; }
+
+		size_t Add(Place p)
+		{
+			const size_t id = nextId++;
+			Push(back, { id, ToUnits(p.time), std::move(p), {} });
+			return id;
+		}
+
+		void Remove(size_t id)
+		{
+			auto find = [id](const std::vector<Frame>& s)
+			{
+				return static_cast<size_t>(std::find_if(s.begin(), s.end(), [id](const Frame& f) { return f.id == id; }) - s.begin());
+			};
+
+			size_t i = find(back);
+			if (i < back.size())
+			{
+				// самые старые места дешевле удалять через передний стек
+				if (!front.empty() || i + 1 == back.size() || i >= back.size() / 2)
+				{
+					Erase(back, i);
+					return;
+				}
+				recomputed += back.size();
+				while (!back.empty())
+				{
+					Frame f = std::move(back.back());
+					back.pop_back();
+					Push(front, std::move(f));
+				}
+			}
+			i = find(front);
+			if (i == front.size()) throw std::out_of_range("no such place");
+			Erase(front, i);
+		}
+
+		// лучшая суммарная важность для времени time <= maxTime
+		int BestValue(float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			return Split(time).second;
+		}
+
+		Route Best(float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			const int c = std::min(BudgetUnits(time), capacity);
+			Route r;
+			if (c < 0) return r;
+			const int a = Split(time).first;
+			Collect(front, a, r);
+			Collect(back, c - a, r);
+			return r;
+		}
+
+	private:
+		struct Frame
+		{
+			size_t				id;
+			int					weight;
+			Place				place;
+			// лучшая важность для каждого времени 0..capacity по местам
+			// от дна стека до этого кадра включительно
+			std::vector<int>	row;
+		};
+
+		void Push(std::vector<Frame>& s, Frame f)
+		{
+			const std::vector<int>* prev = s.empty() ? nullptr : &s.back().row;
+			f.row.assign(static_cast<size_t>(capacity) + 1, 0);
+			for (int w = 0; w <= capacity; ++w)
+			{
+				const int skip = prev ? (*prev)[w] : 0;
+				const int take = (w >= f.weight) ? (prev ? (*prev)[w - f.weight] : 0) + f.place.value : std::numeric_limits<int>::min();
+				f.row[w] = std::max(skip, take);
+			}
+			s.push_back(std::move(f));
+		}
+
+		// удаление кадра i с пересчетом кадров над ним
+		void Erase(std::vector<Frame>& s, size_t i)
+		{
+			std::vector<Frame> above(std::make_move_iterator(s.begin() + i + 1), std::make_move_iterator(s.end()));
+			recomputed += above.size();
+			s.erase(s.begin() + i, s.end());
+			for (auto& f : above) Push(s, std::move(f));
+		}
+
+		// разбиение времени между стеками и лучшая важность
+		std::pair<int, int> Split(float time) const
+		{
+			const int c = std::min(BudgetUnits(time), capacity);
+			if (c < 0) return { 0, 0 };
+			auto at = [](const std::vector<Frame>& s, int w) { return s.empty() ? 0 : s.back().row[w]; };
+			std::pair<int, int> best{ 0, std::numeric_limits<int>::min() };
+			for (int a = 0; a <= c; ++a)
+				if (const int v = at(front, a) + at(back, c - a); v > best.second) best = { a, v };
+			return best;
+		}
+
+		// восстановление мест одного стека для времени w
+		static void Collect(const std::vector<Frame>& s, int w, Route& r)
+		{
+			for (size_t k = s.size(); k-- > 0;)
+			{
+				const int below = k ? s[k - 1].row[w] : 0;
+				if (s[k].row[w] != below)
+				{
+					r.places.push_back(s[k].place);
+					w -= s[k].weight;
+				}
+			}
+		}
+
+		int					capacity;
+		size_t				nextId = 0;
+		size_t				recomputed = 0;
+		std::vector<Frame>	front, back;
+	};
+
+	// точный оптимум для заранее известной последовательности добавлений,
+	// удалений в любом порядке и запросов (разделяй и властвуй по времени).
+	// место живет на отрезке запросов [после добавления, после удаления) и
+	// кладется в O(log Q) вершин дерева отрезков над запросами. Обход дерева
+	// в глубину добавляет строки ДП мест вершины при входе и снимает при
+	// выходе, запрос в листе читает верхнюю строку. Каждое место
+	// обрабатывается O(log Q) раз: всего O((n + Q) log Q * W) без пересчетов
+	class KnapsackTimeline
+	{
+	public:
+		explicit KnapsackTimeline(float maxTime = VISIT_TIME - SLEEP_TIME) : capacity(std::max(BudgetUnits(maxTime), 0)) {}
+
+		// возвращает идентификатор места
+		size_t Add(Place p)
+		{
+			items.push_back({ std::move(p), queries.size(), NOT_REMOVED });
+			return items.size() - 1;
+		}
+
+		void Remove(size_t id)
+		{
+			if (id >= items.size() || items[id].end != NOT_REMOVED) throw std::out_of_range("no such place");
+			items[id].end = queries.size();
+		}
+
+		// запрос к набору мест на текущий момент, возвращает номер ответа
+		size_t Query(float time = VISIT_TIME - SLEEP_TIME)
+		{
+			queries.push_back(std::min(BudgetUnits(time), capacity));
+			return queries.size() - 1;
+		}
+
+		// ответы на все запросы в порядке их номеров
+		std::vector<Route> Run() const
+		{
+			const size_t q = queries.size();
+			std::vector<Route> res(q);
+			if (q == 0) return res;
+
+			std::vector<std::vector<size_t>> tree(4 * q);
+			for (size_t id = 0; id < items.size(); ++id)
+			{
+				const size_t end = std::min(items[id].end, q);
+				if (items[id].begin < end) Assign(tree, 1, 0, q, items[id].begin, end, id);
+			}
+
+			std::vector<std::pair<size_t, std::vector<int>>> stack;
+			Visit(tree, 1, 0, q, stack, res);
+			return res;
+		}
+
+	private:
+		static constexpr size_t NOT_REMOVED = std::numeric_limits<size_t>::max();
+
+		struct Item
+		{
+			Place	place;
+			size_t	begin;
+			size_t	end;
+		};
+
+		// место id живет на запросах [l, r)
+		static void Assign(std::vector<std::vector<size_t>>& tree, size_t node, size_t lo, size_t hi, size_t l, size_t r, size_t id)
+		{
+			if (r <= lo || hi <= l) return;
+			if (l <= lo && hi <= r)
+			{
+				tree[node].push_back(id);
+				return;
+			}
+			const size_t mid = (lo + hi) / 2;
+			Assign(tree, 2 * node, lo, mid, l, r, id);
+			Assign(tree, 2 * node + 1, mid, hi, l, r, id);
+		}
+
+		void Visit(const std::vector<std::vector<size_t>>& tree, size_t node, size_t lo, size_t hi,
+			std::vector<std::pair<size_t, std::vector<int>>>& stack, std::vector<Route>& res) const
+		{
+			const size_t depth = stack.size();
+			for (size_t id : tree[node])
+			{
+				const int weight = ToUnits(items[id].place.time), value = items[id].place.value;
+				std::vector<int> row(static_cast<size_t>(capacity) + 1, 0);
+				const std::vector<int>* prev = stack.empty() ? nullptr : &stack.back().second;
+				for (int w = 0; w <= capacity; ++w)
+				{
+					const int skip = prev ? (*prev)[w] : 0;
+					const int take = (w >= weight) ? (prev ? (*prev)[w - weight] : 0) + value : std::numeric_limits<int>::min();
+					row[w] = std::max(skip, take);
+				}
+				stack.emplace_back(id, std::move(row));
+			}
+
+			if (hi - lo == 1)
+			{
+				int w = queries[lo];
+				for (size_t k = stack.size(); w >= 0 && k-- > 0;)
+				{
+					const int below = k ? stack[k - 1].second[w] : 0;
+					if (stack[k].second[w] != below)
+					{
+						res[lo].places.push_back(items[stack[k].first].place);
+						w -= ToUnits(items[stack[k].first].place.time);
+					}
+				}
+			}
+			else
+			{
+				const size_t mid = (lo + hi) / 2;
+				Visit(tree, 2 * node, lo, mid, stack, res);
+				Visit(tree, 2 * node + 1, mid, hi, stack, res);
+			}
+			stack.resize(depth);
+		}
+
+		int					capacity;
+		std::vector<Item>	items;
+		std::vector<int>	queries;
+	};
+
+	// -------------
+	// запросы "что если"
+	// -------------
+
+	// оптимум с одним обязательным или исключенным местом без повторного
+	// решения: префиксные строки ДП по местам [0, i) и суффиксные по [i, n)
+	// считаются один раз, ответ - слияние двух соседних с i строк за O(W)
+	class WhatIfTable
+	{
+	public:
+		explicit WhatIfTable(std::span<const Place> catalog = places, float maxTime = VISIT_TIME - SLEEP_TIME)
+			: catalog(catalog.begin(), catalog.end()), capacity(std::max(BudgetUnits(maxTime), 0)), width(static_cast<size_t>(capacity) + 1)
+		{
+			const size_t n = catalog.size();
+			weights.reserve(n);
+			for (const auto& p : catalog) weights.push_back(ToUnits(p.time));
+
+			prefix.assign((n + 1) * width, 0);
+			suffix.assign((n + 1) * width, 0);
+			for (size_t i = 0; i < n; ++i)
+				Relax(&prefix[i * width], &prefix[(i + 1) * width], weights[i], catalog[i].value);
+			for (size_t i = n; i-- > 0;)
+				Relax(&suffix[(i + 1) * width], &suffix[i * width], weights[i], catalog[i].value);
+		}
+
+		// лучший маршрут без места i
+		Route Without(size_t i, float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			Check(i);
+			Route r;
+			const int c = std::min(BudgetUnits(time), capacity);
+			if (c >= 0) Merge(i, c, r);
+			return r;
+		}
+
+		// лучший маршрут с местом i, nullopt если оно не помещается
+		std::optional<Route> With(size_t i, float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			Check(i);
+			const int c = std::min(BudgetUnits(time), capacity) - weights[i];
+			if (c < 0) return std::nullopt;
+			Route r;
+			r.places.push_back(catalog[i]);
+			Merge(i, c, r);
+			return r;
+		}
+
+	private:
+		void Relax(const int* src, int* dst, int weight, int value) const
+		{
+			for (size_t w = 0; w < width; ++w)
+				dst[w] = (w >= static_cast<size_t>(weight)) ? std::max(src[w], src[w - weight] + value) : src[w];
+		}
+
+		void Check(size_t i) const
+		{
+			if (i >= catalog.size()) throw std::out_of_range("place index out of range");
+		}
+
+		const int* Prefix(size_t k) const { return &prefix[k * width]; }
+		const int* Suffix(size_t k) const { return &suffix[k * width]; }
+
+		// лучший маршрут по всем местам, кроме i, для времени c
+		void Merge(size_t i, int c, Route& r) const
+		{
+			const int* left = Prefix(i);
+			const int* right = Suffix(i + 1);
+			int split = 0;
+			for (int a = 1; a <= c; ++a)
+				if (left[a] + right[c - a] > left[split] + right[c - split]) split = a;
+
+			// восстановление по разнице соседних строк
+			size_t w = static_cast<size_t>(split);
+			for (size_t k = i; k-- > 0;)
+			{
+				if (Prefix(k + 1)[w] != Prefix(k)[w])
+				{
+					r.places.push_back(catalog[k]);
+					w -= static_cast<size_t>(weights[k]);
+				}
+			}
+			w = static_cast<size_t>(c - split);
+			for (size_t k = i + 1; k < catalog.size(); ++k)
+			{
+				if (Suffix(k)[w] != Suffix(k + 1)[w])
+				{
+					r.places.push_back(catalog[k]);
+					w -= static_cast<size_t>(weights[k]);
+				}
+			}
+		}
+
+		std::vector<Place>	catalog;
+		std::vector<int>	weights;
+		int					capacity;
+		size_t				width;
+		std::vector<int>	prefix, suffix;
+	};
+
+	// -------------
+	// изменяемый каталог
+	// -------------
+
+	// каталог, в который можно добавлять и из которого можно удалять места.
+	// для каждого из порядков первых трех алгоритмов поддерживается
+	// декартово дерево с суммами времени и важности в поддеревьях, поэтому
+	// изменение стоит O(log n), а граница жадного заполнения находится одним
+	// спуском по дереву за O(log n). Маршрут - вывод k выбранных мест, без сортировки
+	class MutableCatalog
+	{
+	public:
+		struct Totals
+		{
+			size_t	count;
+			double	time;
+			int64_t	value;
+		};
+
+		MutableCatalog() = default;
+		explicit MutableCatalog(const std::vector<Place>& catalog)
+		{
+			for (const auto& p : catalog) Add(p);
+		}
+
+		// возвращает идентификатор места, действительный до его удаления
+		size_t Add(Place p)
+		{
+			size_t id;
+			if (freeIds.empty())
+			{
+				id = items.size();
+				items.push_back(std::move(p));
+				alive.push_back(true);
+				for (auto& t : trees) t.nodes.emplace_back();
+			}
+			else
+			{
+				id = freeIds.back();
+				freeIds.pop_back();
+				items[id] = std::move(p);
+				alive[id] = true;
+			}
+			for (auto& t : trees) t.Insert(*this, id, priorities(rng));
+			++count;
+			return id;
+		}
+
+		void Remove(size_t id)
+		{
+			if (id >= items.size() || !alive[id]) throw std::out_of_range("no such place");
+			for (auto& t : trees) t.Erase(*this, id);
+			alive[id] = false;
+			freeIds.push_back(id);
+			--count;
+		}
+
+		void Update(size_t id, Place p)
+		{
+			if (id >= items.size() || !alive[id]) throw std::out_of_range("no such place");
+			for (auto& t : trees) t.Erase(*this, id);
+			items[id] = std::move(p);
+			for (auto& t : trees) t.Insert(*this, id, priorities(rng));
+		}
+
+		size_t Size() const { return count; }
+		const Place& Get(size_t id) const { return items.at(id); }
+
+		// текущее содержимое в порядке идентификаторов, например для точных алгоритмов
+		std::vector<Place> Snapshot() const
+		{
+			std::vector<Place> res;
+			res.reserve(count);
+			for (size_t i = 0; i < items.size(); ++i)
+				if (alive[i]) res.push_back(items[i]);
+			return res;
+		}
+
+		// число мест и суммы ответа одного из первых трех алгоритмов
+		// без построения маршрута, O(log n)
+		Totals Query(Strategy s, float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			return Cutoff(For(s), time);
+		}
+
+		// ответ одного из первых трех алгоритмов
+		Route Greedy(Strategy s, float time = VISIT_TIME - SLEEP_TIME) const
+		{
+			const Tree& t = For(s);
+			const size_t take = Cutoff(t, time).count;
+
+			// первые take мест в порядке дерева
+			Route r;
+			r.places.reserve(take);
+			std::vector<int> stack;
+			for (int n = t.root; r.places.size() < take && (n >= 0 || !stack.empty());)
+			{
+				if (n >= 0)
+				{
+					stack.push_back(n);
+					n = t.nodes[n].left;
+					continue;
+				}
+				n = stack.back();
+				stack.pop_back();
+				r.places.push_back(items[n]);
+				n = t.nodes[n].right;
+			}
+			return r;
+		}
+
+	private:
+		struct Node
+		{
+			int			left = -1;
+			int			right = -1;
+			uint32_t	priority = 0;
+			size_t		count = 0;
+			GreedyTime	sumTime = 0;
+			int64_t		sumValue = 0;
+		};
+
+		// узлы дерева индексируются идентификаторами мест
+		struct Tree
+		{
+			std::function<bool(const Place&, const Place&)>	first;
+			std::vector<Node>								nodes;
+			int												root = -1;
+
+			Tree(std::function<bool(const Place&, const Place&)> first) : first(std::move(first)) {}
+
+			size_t Count(int n) const { return n < 0 ? 0 : nodes[n].count; }
+			GreedyTime Sum(int n) const { return n < 0 ? 0 : nodes[n].sumTime; }
+			int64_t SumValue(int n) const { return n < 0 ? 0 : nodes[n].sumValue; }
+
+			// порядок алгоритма, при равенстве - по идентификатору
+			bool Before(const MutableCatalog& c, size_t a, size_t b) const
+			{
+				if (first(c.items[a], c.items[b])) return true;
+				if (first(c.items[b], c.items[a])) return false;
+				return a < b;
+			}
+
+			void Pull(const MutableCatalog& c, int n)
+			{
+				Node& node = nodes[n];
+				node.count = Count(node.left) + Count(node.right) + 1;
+				node.sumTime = Sum(node.left) + Sum(node.right) + ToGreedyTime(c.items[n].time);
+				node.sumValue = SumValue(node.left) + SumValue(node.right) + c.items[n].value;
+			}
+
+			// разделение на места строго раньше id (или не позже при inclusive) и остальные
+			std::pair<int, int> Split(const MutableCatalog& c, int n, size_t id, bool inclusive)
+			{
+				if (n < 0) return { -1, -1 };
+				const bool goesLeft = Before(c, static_cast<size_t>(n), id) || (inclusive && static_cast<size_t>(n) == id);
+				if (goesLeft)
+				{
+					auto [l, r] = Split(c, nodes[n].right, id, inclusive);
+					nodes[n].right = l;
+					Pull(c, n);
+					return { n, r };
+				}
+				auto [l, r] = Split(c, nodes[n].left, id, inclusive);
+				nodes[n].left = r;
+				Pull(c, n);
+				return { l, n };
+			}
+
+			int Merge(const MutableCatalog& c, int a, int b)
+			{
+				if (a < 0) return b;
+				if (b < 0) return a;
+				if (nodes[a].priority > nodes[b].priority)
+				{
+					nodes[a].right = Merge(c, nodes[a].right, b);
+					Pull(c, a);
+					return a;
+				}
+				nodes[b].left = Merge(c, a, nodes[b].left);
+				Pull(c, b);
+				return b;
+			}
+
+			void Insert(const MutableCatalog& c, size_t id, uint32_t priority)
+			{
+				const int n = static_cast<int>(id);
+				nodes[n] = Node{};
+				nodes[n].priority = priority;
+				Pull(c, n);
+				auto [l, r] = Split(c, root, id, false);
+				root = Merge(c, Merge(c, l, n), r);
+			}
+
+			void Erase(const MutableCatalog& c, size_t id)
+			{
+				auto [l, rest] = Split(c, root, id, false);
+				auto [mid, r] = Split(c, rest, id, true);
+				(void)mid;
+				root = Merge(c, l, r);
+			}
+		};
+
+		const Tree& For(Strategy s) const
+		{
+			switch (s)
+			{
+			case Strategy::MostPlaces:	return trees[0];
+			case Strategy::ByValue:		return trees[1];
+			case Strategy::ByHourValue:	return trees[2];
+			default:					throw std::invalid_argument("only greedy strategies are indexed");
+			}
+		}
+
+		// наибольший префикс порядка с суммарным временем не больше time,
+		// одним спуском от корня. Суммы те же, что у StreamGreedy
+		Totals Cutoff(const Tree& t, float time) const
+		{
+			Totals res{ 0, 0, 0 };
+			GreedyTime left = ToGreedyTime(time), taken = 0;
+			for (int n = t.root; n >= 0;)
+			{
+				const Node& node = t.nodes[n];
+				const GreedyTime prefix = t.Sum(node.left) + ToGreedyTime(items[n].time);
+				if (prefix <= left)
+				{
+					res.count += t.Count(node.left) + 1;
+					res.value += t.SumValue(node.left) + items[n].value;
+					taken += prefix;
+					left -= prefix;
+					n = node.right;
+				}
+				else n = node.left;
+			}
+			res.time = double(taken) / GREEDY_TIME_SCALE;
+			return res;
+		}
+
+		std::vector<Place>					items;
+		std::vector<bool>					alive;
+		std::vector<size_t>					freeIds;
+		size_t								count = 0;
+		std::mt19937						rng{ 12345 };
+		std::uniform_int_distribution<uint32_t>	priorities;
+		Tree								trees[3] =
+		{
+			Tree(CTL),
+			Tree(CVG),
+			Tree(CHVG)
+		};
+	};
+
+	// -------------
+	// сервер планирования
+	// -------------
+
+	// каталог с заранее посчитанными индексами: порядки первых трех
+	// алгоритмов в декартовых деревьях MutableCatalog и таблица ДП для
+	// времени до maxTime. Ответ жадного алгоритма - спуск по дереву,
+	// точного - восстановление по готовой таблице. Остальные запросы
+	// решаются через кэш, если он задан
+	class PlanningIndex
+	{
+	public:
+		explicit PlanningIndex(std::vector<Place> catalog, float maxTime = VISIT_TIME, PlanCache* cache = nullptr)
+			: catalog(std::move(catalog)), cache(cache), fingerprint(CatalogFingerprint(this->catalog)), greedy(this->catalog)
+		{
+			std::vector<int> weights, values;
+			for (const auto& p : this->catalog)
+			{
+				weights.push_back(ToUnits(p.time));
+				values.push_back(p.value);
+			}
+			table = *KnapsackTable::Build(weights, values, BudgetUnits(maxTime));
+		}
+
+		const std::vector<Place>& Catalog() const { return catalog; }
+
+		// можно ли ответить на запрос по готовым индексам, без решения
+		bool IsCheap(const Query& q) const
+		{
+			if (!q.overrides.empty() || !q.constraints.Empty()) return false;
+			switch (q.strategy)
+			{
+			case Strategy::MostPlaces:
+			case Strategy::ByValue:
+			case Strategy::ByHourValue:	return true;
+			case Strategy::Optimal:		return BudgetUnits(q.visitTime - q.sleepTime) <= table.Capacity();
+			default:					return false;
+			}
+		}
+
+		Route Answer(const Query& q, std::stop_token stop = {}) const
+		{
+			if (!IsCheap(q)) return SolveQuery(q, catalog, cache, fingerprint, stop);
+
+			const float time = q.visitTime - q.sleepTime;
+			if (q.strategy != Strategy::Optimal) return greedy.Greedy(q.strategy, time);
+
+			Route r;
+			for (size_t i : table.Select(BudgetUnits(time))) r.places.push_back(catalog[i]);
+			return r;
+		}
+
+	private:
+		std::vector<Place>	catalog;
+		PlanCache*			cache;
+		uint64_t			fingerprint;
+		MutableCatalog		greedy;
+		KnapsackTable		table;
+	};
+
+	// сервер на локальном сокете. Протокол строковый: запрос - строка
+	// в формате пакетного режима, ответ - строка JSON. Запросы одного
+	// соединения обрабатываются по порядку; дешевые запросы решаются прямо
+	// в потоке ввода-вывода, остальные отдаются пулу потоков.
+	// работает до установки stop
+	void RunServer(const std::string& path, const PlanningIndex& index, unsigned threads, const std::atomic<bool>& stop)
+	{
+#ifdef __linux__
+		auto fail = [](std::string_view what) { return std::runtime_error(std::format("{}: {}", what, std::strerror(errno))); };
+
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) throw std::invalid_argument("socket path is too long");
+		std::copy(path.begin(), path.end(), addr.sun_path);
+
+		const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listener < 0) throw fail("socket");
+		unlink(path.c_str());
+		if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0)
+		{
+			close(listener);
+			throw fail("bind");
+		}
+		const int epfd = epoll_create1(EPOLL_CLOEXEC);
+		const int wake = epfd < 0 ? -1 : eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (epfd < 0 || wake < 0)
+		{
+			const auto error = fail(epfd < 0 ? "epoll_create1" : "eventfd");
+			if (epfd >= 0) close(epfd);
+			close(listener);
+			unlink(path.c_str());
+			throw error;
+		}
+
+		// идентификаторы 0 и 1 заняты слушающим сокетом и eventfd
+		constexpr uint64_t LISTENER_ID = 0, WAKE_ID = 1;
+		auto watch = [&](int fd, uint64_t id, uint32_t events, int op)
+		{
+			epoll_event ev{};
+			ev.events = events;
+			ev.data.u64 = id;
+			epoll_ctl(epfd, op, fd, &ev);
+		};
+		watch(listener, LISTENER_ID, EPOLLIN, EPOLL_CTL_ADD);
+		watch(wake, WAKE_ID, EPOLLIN, EPOLL_CTL_ADD);
+
+		struct Connection
+		{
+			int				fd = -1;
+			std::string		in;
+			std::string		out;
+			size_t			line = 0;
+			bool			busy = false;
+			// клиент закрыл свою сторону: оставшиеся строки еще решаются,
+			// ответы отправляются, соединение закрывается после последнего
+			bool			eof = false;
+			// ошибка или полное закрытие клиентом: отвечать больше некому
+			bool			closed = false;
+		};
+		std::unordered_map<uint64_t, Connection> connections;
+		uint64_t nextId = 2;
+
+		std::mutex doneMtx;
+		std::vector<std::pair<uint64_t, std::string>> done;
+		// отмена решений, еще идущих при остановке сервера
+		std::stop_source cancel;
+		std::optional<ThreadPool> pool(std::in_place, threads);
+
+		// отправка ответов и подписка по состоянию соединения: чтение -
+		// до конца входа, чтобы закрытый вход не будил цикл постоянно,
+		// запись - пока есть неотправленные ответы
+		auto flush = [&](uint64_t id, Connection& c)
+		{
+			while (!c.out.empty())
+			{
+				const ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+				if (n > 0) { c.out.erase(0, static_cast<size_t>(n)); continue; }
+				if (n < 0 && errno == EINTR) continue;
+				if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+				c.closed = true;
+				return;
+			}
+			watch(c.fd, id, (c.eof ? 0u : uint32_t(EPOLLIN)) | (c.out.empty() ? 0u : uint32_t(EPOLLOUT)), EPOLL_CTL_MOD);
+		};
+
+		// обработка полных строк соединения, пока не встретится дорогой запрос
+		auto process = [&](uint64_t id, Connection& c)
+		{
+			size_t pos = 0;
+			for (size_t eol; !c.busy && (eol = c.in.find('\n', pos)) != std::string::npos; pos = eol + 1)
+			{
+				const std::string_view text(c.in.data() + pos, eol - pos);
+				++c.line;
+				if (text.find_first_not_of(" \t\r") == std::string_view::npos) continue;
+				Query q = ParseQuery(text, c.line, index.Catalog());
+				if (!q.error.empty() || index.IsCheap(q))
+				{
+					AnswerQuery(q, [&](const Query& q) { return index.Answer(q); }, true, c.out);
+					continue;
+				}
+				c.busy = true;
+				pool->Post([&, id, q = std::move(q), stop = cancel.get_token()]
+					{
+						// исключение в задаче пула завершило бы весь сервер,
+						// поэтому любая ошибка становится ответом на строку
+						std::string out;
+						try
+						{
+							AnswerQuery(q, [&](const Query& q) { return index.Answer(q, stop); }, true, out);
+						}
+						catch (const std::exception& e)
+						{
+							out.clear();
+							Query failed;
+							failed.line = q.line;
+							failed.error = e.what();
+							AnswerQuery(failed, [&](const Query& q) { return index.Answer(q); }, true, out);
+						}
+						{
+							std::lock_guard lock(doneMtx);
+							done.emplace_back(id, std::move(out));
+						}
+						const uint64_t one = 1;
+						[[maybe_unused]] const ssize_t n = write(wake, &one, sizeof(one));
+					});
+			}
+			c.in.erase(0, pos);
+		};
+
+		// закрытие соединения, которому больше нечего делать. Пока его запрос
+		// решается, дескриптор только снимается с наблюдения: ответ задачи
+		// пула найдет соединение по идентификатору
+		auto canClose = [](const Connection& c) { return c.closed || (c.eof && !c.busy && c.out.empty()); };
+		auto drop = [&](uint64_t id)
+		{
+			auto it = connections.find(id);
+			if (it == connections.end()) return;
+			epoll_ctl(epfd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+			if (it->second.busy) return;
+			close(it->second.fd);
+			connections.erase(it);
+		};
+
+		std::vector<epoll_event> events(256);
+		char buf[1 << 16];
+		while (!stop.load())
+		{
+			const int ready = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 200);
+			for (int e = 0; e < ready; ++e)
+			{
+				const uint64_t id = events[e].data.u64;
+				if (id == LISTENER_ID)
+				{
+					for (int fd; (fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0;)
+					{
+						connections[nextId].fd = fd;
+						watch(fd, nextId++, EPOLLIN, EPOLL_CTL_ADD);
+					}
+					continue;
+				}
+				if (id == WAKE_ID)
+				{
+					uint64_t count;
+					[[maybe_unused]] const ssize_t n = read(wake, &count, sizeof(count));
+					std::vector<std::pair<uint64_t, std::string>> finished;
+					{
+						std::lock_guard lock(doneMtx);
+						finished.swap(done);
+					}
+					for (auto& [cid, out] : finished)
+					{
+						Connection& c = connections.at(cid);
+						c.busy = false;
+						c.out.append(out);
+						if (!c.closed) process(cid, c);
+						if (!c.closed) flush(cid, c);
+						if (canClose(c)) drop(cid);
+					}
+					continue;
+				}
+
+				auto it = connections.find(id);
+				if (it == connections.end()) continue;
+				Connection& c = it->second;
+				if (!c.eof && (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+				{
+					while (true)
+					{
+						const ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+						if (n > 0) { c.in.append(buf, static_cast<size_t>(n)); continue; }
+						if (n < 0 && errno == EINTR) continue;
+						if (n == 0)
+						{
+							// последняя строка может быть без перевода строки
+							c.eof = true;
+							if (!c.in.empty() && c.in.back() != '\n') c.in.push_back('\n');
+						}
+						else if (errno != EAGAIN && errno != EWOULDBLOCK) c.closed = true;
+						break;
+					}
+				}
+				if (events[e].events & (EPOLLHUP | EPOLLERR)) c.closed = true;
+				if (!c.closed) process(id, c);
+				if (!c.closed) flush(id, c);
+				if (canClose(c)) drop(id);
+			}
+		}
+
+		// пул завершается первым: оставшиеся задачи еще пишут в wake,
+		// а дескрипторы после закрытия могут быть выданы заново.
+		// идущие решения отменяются, чтобы остановка не ждала их до конца
+		cancel.request_stop();
+		pool.reset();
+		for (auto& [id, c] : connections) close(c.fd);
+		close(wake);
+		close(epfd);
+		close(listener);
+		unlink(path.c_str());
+#else
+		(void)path; (void)index; (void)threads; (void)stop;
+		throw std::runtime_error("server mode requires Linux (epoll)");
+#endif
+	}
+
+	// случайный каталог для замеров производительности.
+	// в коррелированном каталоге важность почти пропорциональна времени,
+	// что делает задачу трудной для метода ветвей и границ
+	std::vector<Place> MakeRandomPlaces(size_t count, unsigned seed = 42, bool correlated = false)
+	{
+		std::mt19937 gen(seed);
+		std::uniform_int_distribution<int> halfHours(1, 24);
+		std::uniform_int_distribution<int> value(1, 20);
+		std::vector<Place> res;
+		res.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const int units = halfHours(gen);
+			res.push_back({ std::format("Place {}", i), units * TIME_STEP, correlated ? units * 10 + 10 : value(gen) });
+		}
 		return res;
 	}
+
+	// замер масштабирования параллельного ДП от 1 до 64 потоков
+	void BenchOptimalScaling()
+	{
+		const auto catalog = MakeRandomPlaces(4000);
+		const float budget = 50000.0f;
+
+		double base = 0;
+		for (unsigned threads = 1; threads <= 64; threads *= 2)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const Route r = VisitOptimal(catalog, budget, threads);
+			const std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+			if (threads == 1) base = sec.count();
+			std::cout << std::format("threads: {:2}; time: {:.3f}s; speedup: {:.2f}x; value: {}\n",
+				threads, sec.count(), base / sec.count(), r.TotalValue());
+		}
+	}
+
+	// замер масштабирования метода ветвей и границ на коррелированном каталоге.
+	// в детерминированном режиме маршрут должен совпадать при любом числе потоков
+	void BenchBranchAndBound()
+	{
+		const auto catalog = MakeRandomPlaces(130, 7, true);
+		const float budget = std::accumulate(catalog.begin(), catalog.end(), 0.0f, [](float t, const Place& p) { return t + p.time; }) / 2 + TIME_STEP / 2;
+
+		double base = 0;
+		std::vector<std::string> reference;
+		for (unsigned threads = 1; threads <= 64; threads *= 2)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const Route r = VisitBranchAndBound(catalog, budget, threads, true);
+			const std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+			std::vector<std::string> names;
+			for (const auto& p : r.places) names.push_back(p.name);
+			if (threads == 1)
+			{
+				base = sec.count();
+				reference = names;
+			}
+			std::cout << std::format("threads: {:2}; time: {:.3f}s; speedup: {:.2f}x; value: {}; same route: {}\n",
+				threads, sec.count(), base / sec.count(), r.TotalValue(), names == reference);
+		}
+	}
+
+	// вытеснение страниц файла из кэша ОС перед холодным замером.
+	// грязные страницы сначала записываются на диск, иначе они не вытесняются.
+	// false, если ОС этого не поддерживает
+	bool DropPageCache(const std::string& path)
+	{
+#ifdef __linux__
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		const bool ok = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		close(fd);
+		return ok;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+
+	// замер запуска: разбор текстового каталога против отображения двоичного.
+	// binPath - готовый двоичный файл; если он не задан, каталог
+	// конвертируется в textPath.tcat. Перед первым отображением страницы
+	// файла вытесняются из кэша ОС, так что оно действительно холодное
+	void BenchStartup(const std::string& textPath, std::string binPath = {})
+	{
+		using clock = std::chrono::steady_clock;
+		auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+		auto start = clock::now();
+		const auto catalog = LoadCatalog(textPath);
+		std::cout << std::format("text parse: {:.2f}ms ({} places)\n", ms(clock::now() - start), catalog.size());
+
+		if (binPath.empty())
+		{
+			binPath = textPath + ".tcat";
+			WriteBinaryCatalog(catalog, binPath);
+		}
+		const bool dropped = DropPageCache(binPath);
+
+		// сумма по столбцам, чтобы страницы действительно были прочитаны
+		auto touch = [](const MappedCatalog& m)
+		{
+			return std::accumulate(m.Times().begin(), m.Times().end(), 0.0) + std::accumulate(m.Values().begin(), m.Values().end(), 0.0);
+		};
+		for (std::string_view phase : { dropped ? "cold" : "cold (page cache not dropped)", "warm" })
+		{
+			start = clock::now();
+			const MappedCatalog mapped(binPath);
+			const auto opened = clock::now();
+			const double sum = touch(mapped);
+			std::cout << std::format("{} map: {:.3f}ms; map + scan: {:.3f}ms (checksum {})\n",
+				phase, ms(opened - start), ms(clock::now() - start), sum);
+		}
+	}
+}
+
+namespace
+{
+	// флаг остановки сервера, выставляется обработчиком сигналов
+	std::atomic<bool> stopServer = false;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-	
+	const std::vector<std::string_view> args(argv + 1, argv + argc);
+	if (!args.empty() && args[0] == "--bench-dp")
+	{
+		test::BenchOptimalScaling();
+		return 0;
+	}
+	if (!args.empty() && args[0] == "--bench-bb")
+	{
+		test::BenchBranchAndBound();
+		return 0;
+	}
+
+	// каталог из файла CSV/TSV или двоичного файла вместо встроенного
+	std::vector<test::Place> catalog = test::places;
+	bool json = false;
+	bool batch = false;
+	std::string batchInput;
+	std::string serverSocket;
+	size_t cacheSize = 0;
+	unsigned threads = std::thread::hardware_concurrency();
+	try
+	{
+		if (args.size() >= 3 && args[0] == "--convert")
+		{
+			test::WriteBinaryCatalog(test::LoadCatalog(std::string(args[1])), std::string(args[2]));
+			return 0;
+		}
+		if (args.size() >= 2 && args[0] == "--bench-startup")
+		{
+			test::BenchStartup(std::string(args[1]), args.size() >= 3 ? std::string(args[2]) : std::string());
+			return 0;
+		}
+		if (args.size() >= 2 && args[0] == "--mapped")
+		{
+			const test::MappedCatalog mapped{ std::string(args[1]) };
+			for (test::Strategy s : test::ALL_STRATEGIES)
+				std::cout << test::PlanMapped(mapped, s) << "\n\n";
+			return 0;
+		}
+
+		for (size_t i = 0; i < args.size(); ++i)
+		{
+			if (args[i] == "--catalog" && i + 1 < args.size()) catalog = test::LoadCatalog(std::string(args[++i]));
+			else if (args[i] == "--threads" && i + 1 < args.size()) threads = static_cast<unsigned>(std::stoul(std::string(args[++i])));
+			else if (args[i] == "--json") json = true;
+			else if (args[i] == "--cache" && i + 1 < args.size()) cacheSize = std::stoul(std::string(args[++i]));
+			else if (args[i] == "--serve" && i + 1 < args.size()) serverSocket = args[++i];
+			else if (args[i] == "--batch")
+			{
+				batch = true;
+				if (i + 1 < args.size() && !args[i + 1].starts_with("--")) batchInput = args[++i];
+			}
+			else throw std::invalid_argument(std::format("unknown argument '{}'", args[i]));
+		}
+
+		// кэш результатов, статистика выводится по завершении
+		std::unique_ptr<test::PlanCache> cache;
+		if (cacheSize) cache = std::make_unique<test::PlanCache>(cacheSize);
+		auto printStats = [&]
+		{
+			if (!cache) return;
+			const auto st = cache->GetStats();
+			std::cerr << std::format("cache: {} hits, {} misses, {} evictions, hit rate {:.1f}%, lookup {:.3f}us, solve {:.3f}us\n",
+				st.hits, st.misses, st.evictions, st.hitRate * 100, st.avgLookupUs, st.avgSolveUs);
+		};
+
+		// сервер: каталог и индексы загружаются один раз
+		if (!serverSocket.empty())
+		{
+			const test::PlanningIndex index(catalog, test::VISIT_TIME, cache.get());
+			std::signal(SIGINT, [](int) { stopServer.store(true); });
+			std::signal(SIGTERM, [](int) { stopServer.store(true); });
+			test::RunServer(serverSocket, index, threads, stopServer);
+			printStats();
+			return 0;
+		}
+
+		// пакетный режим: запросы из файла или стандартного ввода
+		if (batch)
+		{
+			std::ios::sync_with_stdio(false);
+			if (batchInput.empty()) test::RunBatch(std::cin, std::cout, catalog, threads, json, cache.get());
+			else
+			{
+				std::ifstream in(batchInput, std::ios::binary);
+				if (!in) throw std::runtime_error(std::format("cannot open '{}'", batchInput));
+				test::RunBatch(in, std::cout, catalog, threads, json, cache.get());
+			}
+			printStats();
+			return 0;
+		}
+		if (json)
+		{
+			test::JsonRouteWriter writer(std::cout);
+			for (test::Strategy s : test::ALL_STRATEGIES)
+				writer.Write(test::Plan(s, catalog), test::StrategyName(s));
+			return 0;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+	const float time = test::VISIT_TIME - test::SLEEP_TIME;
+
 	std::cout << "\n [ VisitMostPlaces ] \n";
-	std::cout << test::VisitMostPlaces();
+	std::cout << test::VisitMostPlaces(catalog);
 
 	std::cout << "\n\n=================================\n\n";
 	std::cout << "\n [ VisitByValue ] \n";
-	std::cout << test::VisitByValue();
+	std::cout << test::VisitByValue(catalog);
 
 	std::cout << "\n\n=================================\n\n";
 	std::cout << "\n [ VisitByHourValue ] \n";
-	std::cout << test::VisitByHourValue();
-}
\ No newline at end of file
+	std::cout << test::VisitByHourValue(catalog);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ VisitOptimal ] \n";
+	std::cout << test::VisitOptimal(catalog);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ VisitBranchAndBound ] \n";
+	std::cout << test::VisitBranchAndBound(catalog);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ VisitLocalSearch ] \n";
+	std::cout << test::VisitLocalSearch(catalog);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ RunPortfolio ] \n";
+	std::cout << test::RunPortfolio(test::ALL_STRATEGIES, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), catalog, time);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ SolveAnytime ] \n";
+	const auto anytime = test::SolveAnytime(std::chrono::steady_clock::now() + std::chrono::milliseconds(100), {}, catalog, time);
+	std::cout << std::format("Upper bound: {}; Gap: {:.2f}%\n", anytime.upperBound, anytime.gap * 100) << anytime.route;
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ VisitWithinBudget ] \n";
+	const auto withinBudget = test::VisitWithinBudget(catalog);
+	std::cout << std::format("Budget: {}; Total cost: {}\n", test::MONEY_BUDGET, withinBudget.TotalCost()) << withinBudget;
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ RouteEncoder ] \n";
+	std::vector<uint8_t> encoded;
+	test::RouteEncoder(catalog).Encode(test::VisitOptimal(catalog), encoded);
+	const test::RouteView view(encoded);
+	std::cout << std::format("Encoded: {} bytes; Places: {}; Total value: {}\n", view.EncodedSize(), view.Size(), view.TotalValue()) << view.ToRoute(catalog);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ WhatIfTable ] \n";
+	if (!catalog.empty())
+	{
+		// самое важное место обязательно или исключено
+		const test::WhatIfTable whatIf(catalog);
+		const size_t top = static_cast<size_t>(std::max_element(catalog.begin(), catalog.end(),
+			[](const test::Place& a, const test::Place& b) { return a.value < b.value; }) - catalog.begin());
+		std::cout << std::format("With '{}':\n", catalog[top].name);
+		if (const auto with = whatIf.With(top)) std::cout << *with;
+		else std::cout << "does not fit";
+		std::cout << std::format("\n\nWithout '{}':\n", catalog[top].name) << whatIf.Without(top);
+	}
+
+	// короткий осмотр долгих мест: половина времени, две трети важности
+	std::vector<test::Place> variants = catalog;
+	for (const auto& p : catalog)
+		if (p.time >= 4) variants.push_back({ p.name, std::ceil(p.time) / 2, (p.value * 2 + 2) / 3, p.cost });
+	const auto flexible = test::GroupByName(variants);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ SolveMultiChoiceDP ] \n";
+	std::cout << test::SolveMultiChoiceDP(flexible).route;
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ VisitMultiChoiceGreedy ] \n";
+	std::cout << test::VisitMultiChoiceGreedy(flexible).route;
+
+	// места по убыванию важности в час
+	std::vector<size_t> byHourValue(catalog.size());
+	std::iota(byHourValue.begin(), byHourValue.end(), size_t(0));
+	std::stable_sort(byHourValue.begin(), byHourValue.end(),
+		[&](size_t a, size_t b) { return catalog[a].value / catalog[a].time > catalog[b].value / catalog[b].time; });
+
+	// не больше шести платных мест, из двух самых важных в час - одно
+	test::PlaceRules rules;
+	rules.quotas = { { 0, 6 } };
+	for (const auto& p : catalog) rules.category.push_back(p.cost > 0 ? 0 : -1);
+	if (byHourValue.size() >= 2) rules.exclusive.push_back({ byHourValue[0], byHourValue[1] });
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ SolveWithRules ] \n";
+	if (const auto ruled = test::SolveWithRules(rules, catalog)) std::cout << *ruled;
+	else std::cout << "rules cannot be satisfied";
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ VisitWithRules ] \n";
+	if (const auto ruled = test::VisitWithRules(rules, catalog)) std::cout << *ruled;
+	else std::cout << "rules cannot be satisfied";
+
+	// самое важное в час место - только после наименее важного,
+	// второе по важности в час - после третьего, если выбраны оба
+	std::vector<test::Precedence> precedence;
+	if (byHourValue.size() >= 3)
+		precedence = { { byHourValue.back(), byHourValue[0] }, { byHourValue[2], byHourValue[1], false } };
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ SolveWithPrecedence ] \n";
+	std::cout << test::SolveWithPrecedence(precedence, catalog);
+
+	// платные места открыты с 10:00 до 20:00, остальные - в любое время
+	test::Timetable timetable;
+	for (const auto& p : catalog)
+		timetable.windows.push_back(p.cost > 0 ? test::DailyWindows(10, 20, p.time) : std::vector<test::TimeWindow>{});
+	auto printSchedule = [](const test::Schedule& schedule)
+	{
+		std::cout << "Starts (hours from the beginning of the trip):";
+		for (float start : schedule.starts) std::cout << ' ' << start;
+		std::cout << std::format("; Exact: {}\n", schedule.exact) << schedule.route;
+	};
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ ScheduleVisits ] \n";
+	printSchedule(test::ScheduleVisits(timetable, catalog));
+
+	// бесплатные места (прогулки) в полтора раза важнее вечером, с 19:00 до 23:00
+	test::ValueProfile evening = test::FLAT_PROFILE;
+	std::fill(evening.factor.begin() + 19, evening.factor.begin() + 23, 1.5f);
+	std::vector<test::ValueProfile> profiles;
+	for (const auto& p : catalog) profiles.push_back(p.cost > 0 ? test::FLAT_PROFILE : evening);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ PlanTimeDependent ] \n";
+	printSchedule(test::PlanTimeDependent(profiles, timetable, catalog));
+
+	// оптимум без учета риска и маршрут, опаздывающий не чаще чем в 5% сценариев
+	const test::MonteCarloEvaluator evaluator(catalog);
+	const test::RouteRisk optimalRisk = evaluator.Evaluate(test::VisitOptimal(catalog));
+	const test::Route safe = test::PlanChanceConstrained(evaluator, 0.05f);
+	const test::RouteRisk safeRisk = evaluator.Evaluate(safe);
+
+	std::cout << "\n\n=================================\n\n";
+	std::cout << "\n [ PlanChanceConstrained ] \n";
+	std::cout << std::format("VisitOptimal: overrun {:.1f}%, expected value {:.1f}\n", optimalRisk.overrunProbability * 100, optimalRisk.expectedValue);
+	std::cout << std::format("Overrun: {:.1f}%; Expected value: {:.1f}\n", safeRisk.overrunProbability * 100, safeRisk.expectedValue) << safe;
+}